@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+// Micro-benchmarks, built apart from the game with `make bench`. Each
+// one times a bulk or specialised path against the code it replaced,
+// or stands in for, on the same data, and checks the two agree.
+namespace bench {
+	// Milliseconds per call of f: the best of runs rounds of reps
+	// calls, so that other processes and cold caches weigh less.
+	template<class F>
+	double time_ms(F f, int reps = 20, int runs = 5)
+	{
+		double best = 0;
+		for(int run = 0; run < runs; ++run) {
+			const auto start = std::chrono::steady_clock::now();
+			for(int i = 0; i < reps; ++i)
+				f();
+			const double ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count() / reps;
+			if(run == 0 || ms < best)
+				best = ms;
+		}
+		return best;
+	}
+
+	// A line of results: the time of the path it replaced, of the new
+	// one, and the speedup.
+	inline void report(const char* name, double before_ms, double after_ms)
+	{
+		std::cout << "  " << std::left << std::setw(32) << name << std::right
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(10) << before_ms << " ms"
+			<< std::setw(10) << after_ms << " ms"
+			<< std::setprecision(1) << std::setw(8)
+			<< before_ms / std::max(after_ms, 1e-9) << 'x' << std::endl;
+	}
+
+	// Keeps results alive, so that the work timed isn't optimised out.
+	extern volatile size_t sink;
+
+	// Each returns false if the paths disagree.
+	bool rects();
+	bool raycast();
+}
@@ -0,0 +1,46 @@
+#include "bench.hpp"
+
+#include <cstring>
+
+volatile size_t bench::sink;
+
+namespace {
+	struct Bench {
+		const char* name;
+		const char* what;
+		bool (*run)();
+	};
+
+	const Bench BENCHES[] = {
+		{"rects", "tile map rectangle operations "
+			"against per-tile loops", bench::rects},
+		{"raycast", "GridQuery ray casts on the tile map against "
+			"b2World::RayCast on the chain loops", bench::raycast},
+	};
+}
+
+// Run the benchmarks named on the command line, or all of them.
+int main(int argc, char* argv[])
+{
+	if(DEBUG)
+		std::cout << "Built with DEBUG=1: build with the release flags "
+			"for meaningful timings.\n";
+
+	int failed = 0;
+	for(const Bench& b: BENCHES) {
+		bool wanted = argc < 2;
+		for(int i = 1; i < argc; ++i)
+			wanted |= !std::strcmp(argv[i], b.name);
+		if(!wanted)
+			continue;
+
+		std::cout << b.name << ": " << b.what << "\n  "
+			<< std::setw(42) << "before" << std::setw(13) << "after"
+			<< std::endl;
+		if(!b.run()) {
+			std::cout << b.name << ": results differ\n";
+			++failed;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,146 @@
+#include "bench.hpp"
+#include "blueprint.hpp"
+#include "circuit.hpp"
+#include "gridquery.hpp"
+#include "rng.hpp"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+	const uint16_t COLS = 1300, ROWS = 320;
+	const uint64_t SEED = 1;
+	const size_t RAYS = 20000;
+
+	// Longest ray, in tiles, as for line of sight across a few rooms.
+	const float REACH = 60;
+
+	// Hits further apart than this along a ray, in tiles, disagree.
+	const float TOLERANCE = 1e-3f;
+
+	// The closest fixture along a ray.
+	class Closest: public b2RayCastCallback
+	{
+	public:
+		Closest():
+			hit(false), fraction(1)
+		{}
+
+		float32 ReportFixture(b2Fixture*, const b2Vec2&, const b2Vec2&,
+			float32 f) override
+		{
+			hit = true;
+			fraction = f;
+			return f;
+		}
+
+		bool hit;
+		float fraction;
+	};
+
+	// The chain loops Level builds around the walls of map, on a body
+	// at the origin, traced the same way.
+	void build_loops(const Blueprint::TileMap& map, b2Body* body)
+	{
+		const IVec2 max(map.numCols(), map.numRows());
+		HeapMatrix<uint32_t> owners(max.y, max.x * 4, 0);
+		uint32_t id = 0;
+		for(int r = 0; r < max.y; ++r) {
+			for(int c = 0; c < max.x; ++c) {
+				if(map[r][c] == Blueprint::Wwall)
+					continue;
+				for(int s = 0; s < 4; ++s) {
+					const IVec2 wall = IVec2(c, r) - Circuit::FACING[s];
+					if(owners[r][c * 4 + s] || !Circuit::is_wall(map, max, wall))
+						continue;
+					Circuit circuit(map, owners, ++id, max, wall,
+						static_cast<Circuit::Side>(s));
+					const std::vector<b2Vec2>& path = circuit.getPath();
+					b2ChainShape shape;
+					shape.CreateLoop(&path[0], path.size());
+					body->CreateFixture(&shape, 0);
+				}
+			}
+		}
+	}
+
+	// Rays from the open tiles, up to REACH long, ending inside the
+	// map: outside it, the loop around its border would stop them.
+	std::vector<GridQuery::Ray> random_rays(const Blueprint::TileMap& map)
+	{
+		const int cols = map.numCols(), rows = map.numRows();
+		Xoshiro256 rng(SEED);
+		auto uniform = [&](float low, float high) {
+			return low + (high - low) * (rng() >> 40) / float(1 << 24);
+		};
+
+		std::vector<GridQuery::Ray> rays;
+		while(rays.size() < RAYS) {
+			const IVec2 tile(uniform_below(rng, cols), uniform_below(rng, rows));
+			if(map[tile.y][tile.x] == Blueprint::Wwall)
+				continue;
+			GridQuery::Ray ray;
+			ray.from = Blueprint::toCoord(tile)
+				+ b2Vec2(uniform(-0.4f, 0.4f), uniform(-0.4f, 0.4f));
+			const float angle = uniform(0, 2 * b2_pi);
+			const float length = uniform(1, REACH);
+			ray.to = ray.from + length * b2Vec2(std::cos(angle), std::sin(angle));
+			ray.to.x = std::min(std::max(ray.to.x, -0.4f), cols - 0.6f);
+			ray.to.y = std::min(std::max(ray.to.y, 0.6f - rows), 0.4f);
+			rays.push_back(ray);
+		}
+		return rays;
+	}
+}
+
+bool bench::raycast()
+{
+	const Blueprint blueprint(COLS, ROWS, SEED);
+	const Blueprint::TileMap& map = blueprint.getMap();
+
+	b2World world(b2Vec2(0, -10));
+	b2BodyDef def;
+	build_loops(map, world.CreateBody(&def));
+	const GridQuery grid(map, IVec2(COLS, ROWS), b2Vec2(0, 0));
+	const uint32_t walls = GridQuery::tile_mask(Blueprint::Wwall);
+
+	const std::vector<GridQuery::Ray> rays = random_rays(map);
+	std::vector<Closest> closest(rays.size());
+	std::vector<GridQuery::Hit> hits(rays.size());
+
+	auto cast_world = [&]() {
+		for(size_t i = 0; i < rays.size(); ++i) {
+			closest[i] = Closest();
+			world.RayCast(&closest[i], rays[i].from, rays[i].to);
+		}
+	};
+	auto cast_grid = [&]() {
+		for(size_t i = 0; i < rays.size(); ++i)
+			grid.raycast(rays[i].from, rays[i].to, walls, hits[i]);
+	};
+	auto cast_batch = [&]() {
+		grid.raycast(&rays[0], rays.size(), walls, &hits[0]);
+	};
+
+	// Same hits, up to rounding, on both
+	cast_world();
+	cast_batch();
+	size_t differ = 0, hit = 0;
+	for(size_t i = 0; i < rays.size(); ++i) {
+		const float length = (rays[i].to - rays[i].from).Length();
+		hit += hits[i].hit;
+		differ += hits[i].hit != closest[i].hit || (hits[i].hit
+			&& std::abs(hits[i].fraction - closest[i].fraction) * length > TOLERANCE);
+	}
+	std::cout << "  " << rays.size() << " rays on a " << COLS << 'x' << ROWS
+		<< " level, " << hit << " hitting walls, " << differ
+		<< " disagreeing" << std::endl;
+
+	bench::report("b2World::RayCast vs raycast", bench::time_ms(cast_world, 5),
+		bench::time_ms(cast_grid, 5));
+	bench::report("b2World::RayCast vs batch", bench::time_ms(cast_world, 5),
+		bench::time_ms(cast_batch, 5));
+
+	// Rays grazing a corner may hit a wall on one and not the other
+	return differ * 1000 <= rays.size();
+}
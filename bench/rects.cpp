@@ -0,0 +1,153 @@
+#include "bench.hpp"
+#include "heapmatrix.hpp"
+#include "packedtiles.hpp"
+#include "pagedtiles.hpp"
+#include "rng.hpp"
+
+#include <string>
+
+namespace {
+	const size_t SIDE = 2048;
+
+	// All but the first and last columns, so that packed rows start
+	// and end on half a byte.
+	const size_t COL = 1, COLS = SIDE - 2;
+
+	// Tiles the Blueprint stampers would test: walls and ladders.
+	const ValueMask MASK((1u << 1) | (1u << 2));
+
+	template<class Map>
+	void randomise(Map& map, uint64_t seed)
+	{
+		Xoshiro256 rng(seed);
+		for(size_t r = 0; r < map.numRows(); ++r)
+			for(size_t c = 0; c < map.numCols(); ++c)
+				map[r][c] = uniform_below(rng, 5);
+	}
+
+	template<class A, class B>
+	bool same(const A& a, const B& b)
+	{
+		for(size_t r = 0; r < a.numRows(); ++r)
+			for(size_t c = 0; c < a.numCols(); ++c)
+				if(uint8_t(a[r][c]) != uint8_t(b[r][c]))
+					return false;
+		return true;
+	}
+
+	// The loops the operations replace, a tile at a time through the
+	// Row proxies.
+	template<class Map>
+	void fill_loop(Map& map, uint8_t value)
+	{
+		for(size_t r = 0; r < SIDE; ++r)
+			for(size_t c = COL; c < COL + COLS; ++c)
+				map[r][c] = value;
+	}
+
+	template<class Map>
+	void blit_loop(Map& map, const Map& src)
+	{
+		for(size_t r = 0; r < SIDE; ++r)
+			for(size_t c = COL; c < COL + COLS; ++c)
+				map[r][c] = uint8_t(src[r][c]);
+	}
+
+	template<class Map>
+	void replace_loop(Map& map, uint8_t value)
+	{
+		for(size_t r = 0; r < SIDE; ++r)
+			for(size_t c = COL; c < COL + COLS; ++c)
+				if(MASK(uint8_t(map[r][c])))
+					map[r][c] = value;
+	}
+
+	template<class Map>
+	size_t count_loop(const Map& map)
+	{
+		size_t count = 0;
+		for(size_t r = 0; r < SIDE; ++r)
+			for(size_t c = COL; c < COL + COLS; ++c)
+				count += MASK(uint8_t(map[r][c]));
+		return count;
+	}
+
+	// Time count_if, replace_if and fill_rect on a type of map against
+	// the loops.
+	template<class Map>
+	bool compare(const char* type)
+	{
+		Map before(SIDE, SIDE), after(SIDE, SIDE);
+		randomise(before, 1);
+		randomise(after, 1);
+		bool ok = true;
+		const std::string name(type);
+
+		bench::sink = count_loop(before);
+		ok &= bench::sink == after.count_if(0, COL, SIDE, COLS, MASK);
+		bench::report((name + " count_if").c_str(),
+			bench::time_ms([&]() { bench::sink = count_loop(before); }),
+			bench::time_ms([&]() {
+				bench::sink = after.count_if(0, COL, SIDE, COLS, MASK);
+			}));
+
+		// Replacing again changes nothing, each round does the same
+		replace_loop(before, 3);
+		after.replace_if(0, COL, SIDE, COLS, MASK, uint8_t(3));
+		ok &= same(before, after);
+		bench::report((name + " replace_if").c_str(),
+			bench::time_ms([&]() { replace_loop(before, 3); }),
+			bench::time_ms([&]() {
+				after.replace_if(0, COL, SIDE, COLS, MASK, uint8_t(3));
+			}));
+
+		bench::report((name + " fill_rect").c_str(),
+			bench::time_ms([&]() { fill_loop(before, 1); }),
+			bench::time_ms([&]() {
+				after.fill_rect(0, COL, SIDE, COLS, uint8_t(1));
+			}));
+		ok &= same(before, after);
+		return ok;
+	}
+
+	// Time blit_rect from the columns of src starting at src_col.
+	template<class Map>
+	bool compare_blit(const char* name, size_t src_col)
+	{
+		Map before(SIDE, SIDE), after(SIDE, SIDE), src(SIDE, SIDE);
+		randomise(src, 2);
+
+		// The loop copies from the same columns; shifted ones are no
+		// slower through the proxies
+		for(size_t r = 0; r < SIDE; ++r)
+			for(size_t c = COL; c < COL + COLS; ++c)
+				before[r][c] = uint8_t(src[r][c - COL + src_col]);
+		after.blit_rect(0, COL, src, 0, src_col, SIDE, COLS);
+		const bool ok = same(before, after);
+		bench::report(name,
+			bench::time_ms([&]() { blit_loop(before, src); }),
+			bench::time_ms([&]() {
+				after.blit_rect(0, COL, src, 0, src_col, SIDE, COLS);
+			}));
+		return ok;
+	}
+}
+
+bool bench::rects()
+{
+	bool ok = compare<HeapMatrix<uint8_t> >("byte");
+	ok &= compare_blit<HeapMatrix<uint8_t> >("byte blit_rect", COL);
+	ok &= compare<PackedTiles>("packed");
+	ok &= compare_blit<PackedTiles>("packed blit_rect", COL);
+	ok &= compare_blit<PackedTiles>("packed blit_rect, shifted", COL + 1);
+
+	// Paged maps only fill
+	PagedTiles before(SIDE, SIDE), after(SIDE, SIDE);
+	bench::report("paged fill_rect",
+		bench::time_ms([&]() { fill_loop(before, 1); }),
+		bench::time_ms([&]() {
+			after.fill_rect(0, COL, SIDE, COLS, 1);
+		}));
+	ok &= same(before, after);
+	return ok;
+}
@@ -0,0 +1,125 @@
+#include "actors.hpp"
+#include "memstats.hpp"
+#include "trace.hpp"
+
+#include <cassert>
+
+Actors::Actors(b2World& physics, Ogre::SceneManager* sm):
+	mPhysics(physics),
+	mSceneMgr(sm),
+	mSynced(0)
+{}
+
+void Actors::reserve(size_t count)
+{
+	mPositions.reserve(count);
+	mAngles.reserve(count);
+	mVelocities.reserve(count);
+	mBodies.reserve(count);
+	mNodes.reserve(count);
+	mIds.reserve(count);
+	mIndices.reserve(count);
+}
+
+Actors::Id Actors::spawn(const b2Vec2& position, const b2Shape& shape,
+		float density, const Ogre::String& mesh, const Ogre::String& material)
+{
+	b2BodyDef body;
+	body.type = b2_dynamicBody;
+	body.position = position;
+	b2FixtureDef fixture;
+	fixture.shape = &shape;
+	fixture.density = density;
+	return spawn(body, fixture, mesh, material);
+}
+
+Actors::Id Actors::spawn(const b2BodyDef& def, const b2FixtureDef& fixture,
+		const Ogre::String& mesh, const Ogre::String& material)
+{
+	const b2Vec2 position = def.position;
+	b2Body* body = mPhysics.CreateBody(&def);
+	body->CreateFixture(&fixture);
+
+	auto node = mSceneMgr->getRootSceneNode()->createChildSceneNode(
+		Ogre::Vector3(position.x, position.y, 0));
+	auto entity = mSceneMgr->createEntity(mesh);
+	entity->setMaterialName(material);
+	node->attachObject(entity);
+	memstats::fixtures().hold(1, sizeof(b2Fixture));
+	memstats::ogre_objects().hold(1, 0);
+	memstats::ogre_nodes().hold(1, 0);
+
+	Id id;
+	if(mFreeIds.empty()) {
+		id = mIndices.size();
+		mIndices.push_back(size());
+	} else {
+		id = mFreeIds.back();
+		mFreeIds.pop_back();
+		mIndices[id] = size();
+	}
+	mPositions.push_back(position);
+	mAngles.push_back(0);
+	mVelocities.push_back(b2Vec2(0, 0));
+	mBodies.push_back(body);
+	mNodes.push_back(node);
+	mIds.push_back(id);
+	return id;
+}
+
+void Actors::remove(Id id)
+{
+	assert(id < mIndices.size());
+	const uint32_t i = mIndices[id];
+	assert(i < size() && mIds[i] == id);
+
+	mPhysics.DestroyBody(mBodies[i]);
+	mSceneMgr->destroyMovableObject(mNodes[i]->getAttachedObject(0));
+	mSceneMgr->destroySceneNode(mNodes[i]);
+	memstats::fixtures().hold(-1, -int64_t(sizeof(b2Fixture)));
+	memstats::ogre_objects().hold(-1, 0);
+	memstats::ogre_nodes().hold(-1, 0);
+
+	// The last one takes its place
+	const uint32_t last = size() - 1;
+	mPositions[i] = mPositions[last];
+	mAngles[i] = mAngles[last];
+	mVelocities[i] = mVelocities[last];
+	mBodies[i] = mBodies[last];
+	mNodes[i] = mNodes[last];
+	mIds[i] = mIds[last];
+	mIndices[mIds[i]] = i;
+
+	mPositions.pop_back();
+	mAngles.pop_back();
+	mVelocities.pop_back();
+	mBodies.pop_back();
+	mNodes.pop_back();
+	mIds.pop_back();
+	mFreeIds.push_back(id);
+}
+
+void Actors::sync_nodes()
+{
+	TRACE_SCOPE("Actors::sync_nodes");
+
+	// Resting bodies keep their transforms exactly, so most of the
+	// nodes are left alone
+	mSynced = 0;
+	const size_t count = size();
+	for(size_t i = 0; i < count; ++i) {
+		const b2Body* body = mBodies[i];
+		mVelocities[i] = body->GetLinearVelocity();
+
+		const b2Vec2& p = body->GetPosition();
+		const float angle = body->GetAngle();
+		if(p == mPositions[i] && angle == mAngles[i])
+			continue;
+		mPositions[i] = p;
+		mAngles[i] = angle;
+		mNodes[i]->setPosition(p.x, p.y, 0);
+		mNodes[i]->setOrientation(Ogre::Quaternion(Ogre::Radian(angle),
+			Ogre::Vector3::UNIT_Z));
+		++mSynced;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <vector>
+#include <cstdint>
+
+// Dynamic bodies drawn in the scene, such as pills and characters.
+//
+// As with Movers, there is no actor object: the state of every actor
+// lives in parallel arrays, so that syncing the scene with the physics
+// is one pass over contiguous memory, without virtual calls. Actors
+// are named by ids, which stay valid while others come and go.
+class Actors
+{
+public:
+	typedef uint32_t Id;
+
+	Actors(b2World& physics, Ogre::SceneManager* sm);
+
+	Actors(const Actors&) = delete;
+	Actors& operator=(const Actors&) = delete;
+
+	// Make room for count actors, so that spawning up to that many
+	// doesn't grow the arrays.
+	void reserve(size_t count);
+
+	// A dynamic body with a fixture of shape, at position in world
+	// coordinates, drawn with an entity of mesh in material.
+	Id spawn(const b2Vec2& position, const b2Shape& shape, float density,
+		const Ogre::String& mesh, const Ogre::String& material);
+
+	// Likewise with a body and a fixture of any kind.
+	Id spawn(const b2BodyDef& body, const b2FixtureDef& fixture,
+		const Ogre::String& mesh, const Ogre::String& material);
+
+	// Destroy the body and the node of an actor. Its id may be given
+	// to the next one spawned.
+	void remove(Id id);
+
+	// Copy the transforms of the bodies that moved since the last call
+	// into their scene nodes. To be called after each physics step.
+	void sync_nodes();
+
+	size_t size() const
+	{
+		return mBodies.size();
+	}
+
+	b2Body* body(Id id) const
+	{
+		return mBodies[mIndices[id]];
+	}
+
+	// As of the last sync_nodes().
+	const b2Vec2& position(Id id) const
+	{
+		return mPositions[mIndices[id]];
+	}
+
+	const b2Vec2& velocity(Id id) const
+	{
+		return mVelocities[mIndices[id]];
+	}
+
+	// Nodes written by the last sync_nodes().
+	size_t synced() const
+	{
+		return mSynced;
+	}
+
+private:
+	b2World& mPhysics;
+	Ogre::SceneManager* mSceneMgr;
+
+	// Per actor, indexed alike, the last one moving into the place of
+	// one removed:
+	std::vector<b2Vec2> mPositions;	// as last written to the node
+	std::vector<float> mAngles;	// likewise
+	std::vector<b2Vec2> mVelocities;
+	std::vector<b2Body*> mBodies;
+	std::vector<Ogre::SceneNode*> mNodes;
+	std::vector<Id> mIds;
+
+	// Index of each id in the arrays above, and ids of removed actors.
+	std::vector<uint32_t> mIndices;
+	std::vector<Id> mFreeIds;
+
+	size_t mSynced;
+};
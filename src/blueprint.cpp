@@ -5,26 +5,30 @@
 #include <cassert>
 
 #include "blueprint.hpp"
+#include "memstats.hpp"
+#include "trace.hpp"
 
-std::mt19937 rand_gen((std::random_device())());
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::BasicBlueprint(size_t cols, size_t rows, uint64_t seed):
+	BasicBlueprint(Map(rows, cols), seed)
+{}
 
-const float Blueprint::ROWS_PER_ROOM = 16;
-const float Blueprint::COLS_PER_ROOM = 26;
-
-Blueprint::Blueprint(size_t cols, size_t rows):
-	dim(cols, rows),
-	max_obj(2, 2),
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::BasicBlueprint(Map&& tiles, uint64_t seed):
+	dim(tiles.numCols(), tiles.numRows()),
 	moversNum(0),
-	map(rows + ROWS_PER_ROOM, cols + COLS_PER_ROOM),
-	coin(0, 1)
+	map(std::move(tiles)),
+	rng(seed)
 {
-	rooms.x = (uint16_t) ceilf(cols / COLS_PER_ROOM);
-	rooms.y = (uint16_t) ceilf(rows / ROWS_PER_ROOM);
+	TRACE_SCOPE("Blueprint::Blueprint");
+
+	rooms.x = (uint16_t) ((dim.x + COLS_PER_ROOM - 1) / COLS_PER_ROOM);
+	rooms.y = (uint16_t) ((dim.y + ROWS_PER_ROOM - 1) / ROWS_PER_ROOM);
 
 	if (DEBUG) {
 		std::cout << "Size..."
 			<< "\n  ...in rooms: " << rooms.x << 'x' << rooms.y
-			<< "\n  ...in blocks: " << cols << 'x' << rows
+			<< "\n  ...in blocks: " << dim.x << 'x' << dim.y
 			<< std::endl;
 	}
 
@@ -53,14 +57,14 @@ Blueprint::Blueprint(size_t cols, size_t rows):
 	// Compute middles
 	middleRows.reserve(rooms.y + 1);
 	for (int riR = 0; riR < rooms.y; riR++) {
-		std::uniform_int_distribution<> choice(1, ROWS_PER_ROOM - 2 * (max_obj.y + 1));
-		middleRows.push_back(max_obj.y + choice(rand_gen));
+		middleRows.push_back(MAX_OBJ_ROWS
+			+ uniform_int(rng, 1, ROWS_PER_ROOM - 2 * (MAX_OBJ_ROWS + 1)));
 	}
 
 	middleCols.reserve(rooms.x + 1);
 	for (int riC = 0; riC < rooms.x; riC++) {
-		std::uniform_int_distribution<> choice(1, COLS_PER_ROOM - 2 * (max_obj.x + 1));
-		middleCols.push_back(max_obj.x + choice(rand_gen));
+		middleCols.push_back(MAX_OBJ_COLS
+			+ uniform_int(rng, 1, COLS_PER_ROOM - 2 * (MAX_OBJ_COLS + 1)));
 	}
 
 	// Fill in walls between rooms and ladders,
@@ -70,9 +74,18 @@ Blueprint::Blueprint(size_t cols, size_t rows):
 	add_movers();
 
 	extra_walls();
+
+	memstats::blueprint().hold(1, memory());
 }
 
-void Blueprint::dump(const char *filename)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::~BasicBlueprint()
+{
+	memstats::blueprint().hold(-1, -int64_t(memory()));
+}
+
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::dump(const char *filename)
 {
 	const int SCALE = 16;
 	const char* const colormap[] = {
@@ -85,17 +98,19 @@ void Blueprint::dump(const char *filename)
 	std::ofstream out(filename);
 	out << "P3\n" << map.numCols()*SCALE << ' ' << map.numRows()*SCALE << '\n' << "255\n";
 
-	for (const auto& row: this->map)
+	const Map& tiles = map;
+	for (size_t r = 0; r < tiles.numRows(); ++r)
 		for(uint8_t i = 0; i < SCALE; ++i) {
-			for (const auto& col: row) {
+			for (size_t c = 0; c < tiles.numCols(); ++c) {
 				for(uint8_t j = 0; j < SCALE; ++j)
-					out << colormap[col] << ' ';
+					out << colormap[tiles[r][c]] << ' ';
 			}
 			out << '\n';
 		}
 }
 
-bool Blueprint::is_room_open(const RoomIndex & ri) const
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::is_room_open(const RoomIndex & ri) const
 {
 	return !(((ri.across > 0) && horiz[ri.down][ri.across - 1])
 			|| ((ri.across < rooms.x) && horiz[ri.down][ri.across])
@@ -104,34 +119,33 @@ bool Blueprint::is_room_open(const RoomIndex & ri) const
 		);
 }
 
-void Blueprint::fill_random()
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::fill_random()
 {
+	TRACE_SCOPE("Blueprint::fill_random");
+
 	if ((rooms.x < 2) || (rooms.y < 2))
 		return;
 
 	const float STRAND_PERCENT = 0.5f;
 	const int STRAND_LENGTH = 8;
 
-	std::uniform_int_distribution <> rand_strand(0, STRAND_LENGTH - 1);
-	std::uniform_int_distribution <> rand_across(1, rooms.x);
-	std::uniform_int_distribution <> rand_down(1, rooms.y);
-
 	int strandsNum = (int)(rooms.x * rooms.y * STRAND_PERCENT);
 
 	for (int n = 0; n < strandsNum; n++) {
 		// Starting position.
 		RoomIndex ri;
-		ri.across = rand_across(rand_gen);
-		ri.down = rand_down(rand_gen);
+		ri.across = uniform_int(rng, 1, rooms.x);
+		ri.down = uniform_int(rng, 1, rooms.y);
 
 		bool ok = is_room_open(ri);
 
 		// open implies that ri must not be on outer boundaries.
-		while (rand_strand(rand_gen) && ok) {
+		while (uniform_below(rng, STRAND_LENGTH) && ok) {
 			// Move horiz.
-			if (coin(rand_gen)) {
+			if (coin()) {
 				// Increase.
-				if (coin(rand_gen)) {
+				if (coin()) {
 					horiz[ri.down][ri.across] = true;
 					ri.across++;
 				}
@@ -144,7 +158,7 @@ void Blueprint::fill_random()
 			// Move vert.
 			else {
 				// Increase.
-				if (coin(rand_gen)) {
+				if (coin()) {
 					vert[ri.down][ri.across] = true;
 					ri.down++;
 				}
@@ -159,91 +173,94 @@ void Blueprint::fill_random()
 	}
 }
 
-void Blueprint::has_top(const RoomIndex &, const IVec2 & roomLoc)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::stamp(IVec2 from, IVec2 to, Tiles t)
 {
-	for (int c = roomLoc.x; c < roomLoc.x + COLS_PER_ROOM; c++) {
-		map[roomLoc.y][c] = Wwall;
+	from = IVec2(std::max(from.x, 0), std::max(from.y, 0));
+	to = IVec2(std::min(to.x, dim.x), std::min(to.y, dim.y));
+	if (from.x < to.x && from.y < to.y) {
+		map.fill_rect(from.y, from.x, to.y - from.y, to.x - from.x, t);
 	}
 }
 
-void Blueprint::missing_top(const RoomIndex & roomIndex,
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::has_top(const RoomIndex &, const IVec2 & roomLoc)
+{
+	stamp(roomLoc, roomLoc + IVec2(COLS_PER_ROOM, 1), Wwall);
+}
+
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::missing_top(const RoomIndex & roomIndex,
 		const IVec2 & roomLoc)
 {
-	for (int c = roomLoc.x + middleCols[roomIndex.across];
-			c < roomLoc.x + middleCols[roomIndex.across] + max_obj.x;
-			c++) {
-		for (int r = roomLoc.y; r < roomLoc.y + ROWS_PER_ROOM - 1;
-				r++) {
-			map[r][c] = Wladder;
-		}
-	}
+	const int c = roomLoc.x + middleCols[roomIndex.across];
+	stamp(IVec2(c, roomLoc.y),
+		IVec2(c + MAX_OBJ_COLS, roomLoc.y + ROWS_PER_ROOM - 1), Wladder);
 }
 
-void Blueprint::has_bottom(const RoomIndex &, const IVec2 & roomLoc)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::has_bottom(const RoomIndex &, const IVec2 & roomLoc)
 {
-	for (int c = roomLoc.x; c < roomLoc.x + COLS_PER_ROOM; c++) {
-		map[roomLoc.y + ROWS_PER_ROOM - 1][c] = Wwall;
-	}
+	stamp(IVec2(roomLoc.x, roomLoc.y + ROWS_PER_ROOM - 1),
+		roomLoc + IVec2(COLS_PER_ROOM, ROWS_PER_ROOM), Wwall);
 }
 
-void Blueprint::missing_bottom(const RoomIndex & roomIndex,
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::missing_bottom(const RoomIndex & roomIndex,
 		const IVec2 & roomLoc)
 {
-	for (int c = roomLoc.x + middleCols[roomIndex.across];
-	     c < roomLoc.x + middleCols[roomIndex.across] + max_obj.x;
-	     c++) {
-		for (int r =
-				roomLoc.y + middleRows[roomIndex.down] - max_obj.y;
-				r < roomLoc.y + ROWS_PER_ROOM; r++) {
-			map[r][c] = Wladder;
-		}
-	}
+	const int c = roomLoc.x + middleCols[roomIndex.across];
+	stamp(IVec2(c, roomLoc.y + middleRows[roomIndex.down] - MAX_OBJ_ROWS),
+		IVec2(c + MAX_OBJ_COLS, roomLoc.y + ROWS_PER_ROOM), Wladder);
 }
 
-void Blueprint::has_left(const RoomIndex &, const IVec2 & roomLoc)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::has_left(const RoomIndex &, const IVec2 & roomLoc)
 {
-	for (int r = roomLoc.y; r < roomLoc.y + ROWS_PER_ROOM; r++) {
-		map[r][roomLoc.x] = Wwall;
-	}
+	stamp(roomLoc, roomLoc + IVec2(1, ROWS_PER_ROOM), Wwall);
 }
 
-void Blueprint::missing_left(const RoomIndex & roomIndex,
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::missing_left(const RoomIndex & roomIndex,
 			     const IVec2 & roomLoc)
 {
-	for (int c = roomLoc.x;
-			c < roomLoc.x + middleCols[roomIndex.across]; c++) {
-		map[roomLoc.y + middleRows[roomIndex.down]][c] = Wwall;
-	}
+	const int r = roomLoc.y + middleRows[roomIndex.down];
+	stamp(IVec2(roomLoc.x, r),
+		IVec2(roomLoc.x + middleCols[roomIndex.across], r + 1), Wwall);
 }
 
-void Blueprint::has_right(const RoomIndex &, const IVec2 & roomLoc)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::has_right(const RoomIndex &, const IVec2 & roomLoc)
 {
-	for (int r = roomLoc.y; r < roomLoc.y + ROWS_PER_ROOM; r++) {
-		map[r][roomLoc.x + COLS_PER_ROOM - 1] = Wwall;
-	}
+	stamp(IVec2(roomLoc.x + COLS_PER_ROOM - 1, roomLoc.y),
+		roomLoc + IVec2(COLS_PER_ROOM, ROWS_PER_ROOM), Wwall);
 }
 
-void Blueprint::missing_right(const RoomIndex & roomIndex,
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::missing_right(const RoomIndex & roomIndex,
 			      const IVec2 & roomLoc)
 {
-	for (int c = roomLoc.x + middleCols[roomIndex.across] + max_obj.x;
-			c < roomLoc.x + COLS_PER_ROOM; c++) {
-		map[roomLoc.y + middleRows[roomIndex.down]][c] = Wwall;
-	}
+	const int r = roomLoc.y + middleRows[roomIndex.down];
+	stamp(IVec2(roomLoc.x + middleCols[roomIndex.across] + MAX_OBJ_COLS, r),
+		IVec2(roomLoc.x + COLS_PER_ROOM, r + 1), Wwall);
 }
 
-void Blueprint::implement_rooms()
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::implement_rooms()
 {
+	TRACE_SCOPE("Blueprint::implement_rooms");
+
 	RoomIndex ri;
 	IVec2 rl;
 
-	// Walls between rooms.
-	for (ri.across = 0, rl.x = 0;
-			ri.across < rooms.x;
-			ri.across++, rl.x += COLS_PER_ROOM) {
-		for (ri.down = 0, rl.y = 0;
-				ri.down < rooms.y;
-				ri.down++, rl.y += ROWS_PER_ROOM) {
+	// Walls between rooms. Each room only writes its own tiles: going
+	// a row of rooms at a time keeps writes together in memory.
+	for (ri.down = 0, rl.y = 0;
+			ri.down < rooms.y;
+			ri.down++, rl.y += ROWS_PER_ROOM) {
+		for (ri.across = 0, rl.x = 0;
+				ri.across < rooms.x;
+				ri.across++, rl.x += COLS_PER_ROOM) {
 			if (!horiz[ri.down][ri.across]) {
 				missing_top(ri, rl);
 			} else {
@@ -268,18 +285,21 @@ void Blueprint::implement_rooms()
 	}
 }
 
-bool Blueprint::inside(const IVec2 &l)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::inside(const IVec2 &l) const
 {
 	return l.y >= 0 && l.x >= 0
 			&& l.y < dim.y && l.x < dim.x;
 }
 
-bool Blueprint::inside(int r, int c)
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::inside(int r, int c) const
 {
 	return inside(IVec2(c, r));
 }
 
-bool Blueprint::is_tile_open(const IVec2 &loc, bool laddersClosed,
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::is_tile_open(const IVec2 &loc, bool laddersClosed,
 		bool postersClosed, bool doorsClosed, bool outsideClosed)
 {
 	if (!inside(loc)) {
@@ -323,8 +343,11 @@ bool Blueprint::is_tile_open(const IVec2 &loc, bool laddersClosed,
   return ret;
 }
 
-void Blueprint::add_movers()
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::add_movers()
 {
+	TRACE_SCOPE("Blueprint::add_movers");
+
 	// A factor of "density" of movers on the level
 	const float MOVERS_PERCENT = 0.4;
 
@@ -332,16 +355,26 @@ void Blueprint::add_movers()
 	// of times before giving up.
 	const int MOVER_TRIES = 6;
 
-	// Movers shouldn't be too big.
-	assert(max_obj.x >= 2);
-
 	// Number of movers to create.
-	std::uniform_int_distribution<> rand_movers(0,
+	const int moversActual = uniform_int(rng, 0,
 		(int)(rooms.x * rooms.y * MOVERS_PERCENT));
-	const int moversActual = rand_movers(rand_gen);
+
+	// Horizontal movers need MOVERS_HORIZ_MIN_TRACK movers of room,
+	// plus one on either side, with a floor and a ceiling.
+	moverSpots.build(map, dim,
+		IVec2((MOVERS_HORIZ_MIN_TRACK + 2) * MAX_OBJ_COLS, 2 * MAX_OBJ_ROWS + 1),
+		Wempty);
+
+	// Lift rooms in a FenwickTree, by room index, so that the k-th one
+	// is found without going through them all.
+	std::vector<int64_t> lifts(rooms.x * rooms.y);
+	for (int d = 0; d < rooms.y; d++)
+		for (int a = 0; a < rooms.x; a++)
+			lifts[d * rooms.x + a] = is_lift_room(IVec2(a, d));
+	liftRooms.assign(lifts);
 
 	for (int n = 0; n < moversActual; n++) {
-		bool which = coin(rand_gen);
+		bool which = coin();
 		bool ok = false;
 	    int tries = 0;
 	    while (!ok && tries < MOVER_TRIES) {
@@ -352,37 +385,44 @@ void Blueprint::add_movers()
 		if(ok)
 			++moversNum;
 	}
+
+	moverSpots.clear();
+	liftRooms.clear();
 }
 
-bool Blueprint::add_horiz_mover()
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::is_lift_room(const IVec2& room) const
+{
+	const int r = room.y * ROWS_PER_ROOM + middleRows[room.y];
+	const int c = room.x * COLS_PER_ROOM + middleCols[room.x];
+	// Rooms of the last row or column may be cut by the map edge.
+	return inside(r, c + 1)
+		&& map[r][c] == Wladder && map[r][c + 1] == Wladder;
+}
+
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::add_horiz_mover()
 {
-	// Min number of movers across a horizontal track must be.
-	const int MOVERS_HORIZ_MIN_TRACK = 6;
 	const int MOVERS_HORIZ_TRACK_LENGTH = 25;
 
+	// A random start would have space around it for the minimum track
+	// length with this probability: draw against it, then pick one of
+	// the starts that do, instead of checking random ones.
+	if (uniform_below(rng, uint64_t(dim.x) * dim.y) >= moverSpots.size()) {
+		return false;
+	}
+	const IVec2 spot = moverSpots.at(uniform_below(rng, moverSpots.size()));
+
 	// loc will walk right or left, filling in track.
+	int delta = coin() ? 1 : -1;  // right or left.
 	IVec2 loc;
-	loc.y = std::uniform_int_distribution<>(0, dim.y - 1)(rand_gen);
-	loc.x = std::uniform_int_distribution<>(0, dim.x - 1)(rand_gen);
-
-	// Check space surrounding initial choice for minimum track length.
-	int delta = coin(rand_gen) ? 1 : -1;  // right or left.
+	loc.y = spot.y + MAX_OBJ_ROWS;
+	loc.x = spot.x + (delta == -1 ? MOVERS_HORIZ_MIN_TRACK : 1) * MAX_OBJ_COLS;
 	IVec2 check;
-	for (check.x = loc.x - (delta == -1 ? MOVERS_HORIZ_MIN_TRACK : 1) * max_obj.x;
-			check.x < loc.x + (delta == 1 ? MOVERS_HORIZ_MIN_TRACK + 1 : 2) * max_obj.x; // mover track plus blank space
-			check.x++) {
-		for (check.y = loc.y - max_obj.y;
-				check.y <= loc.y + max_obj.y;
-				check.y++) {
-			if (!is_tile_open(check, true, true, true)) {
-				return false;
-			}
-		}
-	}
 
 	// Start at the right edge of the mover and go left
 	if (delta == -1) {
-		loc.x += max_obj.x - 1;
+		loc.x += MAX_OBJ_COLS - 1;
 	}
 	// else we are at the left edge going right.
 
@@ -395,19 +435,19 @@ bool Blueprint::add_horiz_mover()
 	// Must do at least MOVERS_HORIZ_MIN_TRACK multiples of the mover width.
 	int n = 0;
 	bool ok = true;
-	while(ok && (n <= MOVERS_HORIZ_MIN_TRACK * max_obj.x || 
-			std::uniform_int_distribution<>(0, MOVERS_HORIZ_TRACK_LENGTH-1)(rand_gen))) {
+	while(ok && (n <= MOVERS_HORIZ_MIN_TRACK * MAX_OBJ_COLS || 
+			uniform_below(rng, MOVERS_HORIZ_TRACK_LENGTH))) {
 		// Check if we can put a mover at loc.
 		for (check.x = loc.x;
-				check.x != loc.x + delta * max_obj.x;
+				check.x != loc.x + delta * MAX_OBJ_COLS;
 				check.x += delta) {
-			for (check.y = loc.y - max_obj.y;
-					check.y <= loc.y + max_obj.y;
+			for (check.y = loc.y - MAX_OBJ_ROWS;
+					check.y <= loc.y + MAX_OBJ_ROWS;
 					check.y++) {
 				if (!is_tile_open(check, true, true, true)) {
 					ok = false;
 					// Our above check of the surrounding space was not correct.
-					assert(n >= MOVERS_HORIZ_MIN_TRACK * max_obj.x);
+					assert(n >= MOVERS_HORIZ_MIN_TRACK * MAX_OBJ_COLS);
 				}
 				if (!ok) {
 					break;
@@ -421,7 +461,7 @@ bool Blueprint::add_horiz_mover()
 		// Add mover track at loc.
 		if (ok) {
 			// Add a mover square.
-			map[loc.y][loc.x] = WmoverTrack;
+			set_tile(loc, WmoverTrack);
 
 			left = std::min<int>(left, loc.x);
 			right = std::max<int>(right, loc.x);
@@ -432,30 +472,34 @@ bool Blueprint::add_horiz_mover()
 	} // while ok
 
 	// Check again that we got enough track.
-	assert(right - left + 1 >= MOVERS_HORIZ_MIN_TRACK * max_obj.x);
+	assert(right - left + 1 >= MOVERS_HORIZ_MIN_TRACK * MAX_OBJ_COLS);
 
 	return true;
 }
 
 // What an ugly function.  I should redo this.
-bool Blueprint::add_vert_mover()
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+bool BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::add_vert_mover()
 {
 	// Choose a random room, check if its middle is a ladder, if so, change
 	// the ladder to a bunch of mover squares and create a new mover.
 	// Else continue.
+	// Rooms are only drawn among liftRooms, as often as a random
+	// room would be one of them.
+	if (uniform_below(rng, rooms.x * rooms.y) >= size_t(liftRooms.total())) {
+		return false;
+	}
+	int64_t k = uniform_below(rng, liftRooms.total());
+	const int index = liftRooms.find(k);
+	const IVec2 room(index % rooms.x, index / rooms.x);
 	IVec2 init;
-	int m; // holder for the down/across value of the room chosen.
-	m = std::uniform_int_distribution<>(0, rooms.x - 1)(rand_gen);
-	init.x =  m * COLS_PER_ROOM + middleCols[m];
-	m = std::uniform_int_distribution<>(0, rooms.y - 1)(rand_gen);
-	init.y =  m * ROWS_PER_ROOM + middleRows[m];
+	init.x =  room.x * COLS_PER_ROOM + middleCols[room.x];
+	init.y =  room.y * ROWS_PER_ROOM + middleRows[room.y];
 
 	// Found a ladder, create a new mover and set all the ladder wsquares to be
 	// MoverSquares pointing to the new mover.
-	if (!(map[init.y][init.x] == Wladder && 
-			map[init.y][init.x+1] == Wladder)) {
-		return false;
-	} 
+	assert(map[init.y][init.x] == Wladder && 
+			map[init.y][init.x+1] == Wladder);
 
 	// All wsquares between top and bottom, exclusive, are part of the
 	// mover.
@@ -489,15 +533,13 @@ bool Blueprint::add_vert_mover()
 		while (bothLadders ||  // normal case 
 				(delta == 1 && aboveMoverSq && bothWalls) ) { // sticking down one
 			// Scan to right.
-			for (; loc.x < init.x + max_obj.x; loc.x++) {
+			for (; loc.x < init.x + MAX_OBJ_COLS; loc.x++) {
 				// Add a mover square.
 				assert(inside(loc) && 
 					(map[loc.y][loc.x] == Wladder || map[loc.y][loc.x] == Wwall));
-				map[loc.y][loc.x] = WliftTrack;
-
 				// Still leave overlap of wall and moversquare.
 				if (map[loc.y][loc.x] != Wwall) {
-					map[loc.y][loc.x] = Wempty;
+					set_tile(loc, WliftTrack);
 				}
 
 				top = std::min<int>(top, loc.y);
@@ -508,11 +550,11 @@ bool Blueprint::add_vert_mover()
 			// When up at the top.
 			// Remove annoying ladder sticking up.
 			if (delta ==  -1 &&
-					map[loc.y - max_obj.y - 1][loc.x] != Wladder) {
-				int locTop = loc.y - max_obj.y;
+					map[loc.y - MAX_OBJ_ROWS - 1][loc.x] != Wladder) {
+				int locTop = loc.y - MAX_OBJ_ROWS;
 				for (loc.y--; loc.y >= locTop; loc.y--) {
-					for (loc.x = init.x; loc.x < init.x + max_obj.x; loc.x++) {
-						map[loc.y][loc.x] = Wempty;
+					for (loc.x = init.x; loc.x < init.x + MAX_OBJ_COLS; loc.x++) {
+						set_tile(loc, Wempty);
 					}
 				}
 
@@ -542,10 +584,19 @@ bool Blueprint::add_vert_mover()
 
 	assert(top < bottom);  // Or no squares were added.
 
+	// The lift may run through the middle of other rooms, all in the
+	// same column of rooms. Lift rooms only ever become other rooms.
+	for (int d = 0; d < rooms.y; d++) {
+		const int r = d * rooms.x + room.x;
+		if (liftRooms.count(r) && !is_lift_room(IVec2(room.x, d)))
+			liftRooms.add(r, -1);
+	}
+
 	return true;
 }
 
-void Blueprint::ladder(const IVec2 &init) {
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::ladder(const IVec2 &init) {
 	// delta is only -1 and 1.
 	for (int delta = -1; delta <= 1; delta += 2) {
 		IVec2 loc = init;
@@ -557,7 +608,7 @@ void Blueprint::ladder(const IVec2 &init) {
 
 		// Running directly into wall or ladder.
 		while (is_tile_open(loc, true)) {
-			map[loc.y][loc.x] = Wladder;
+			set_tile(loc, Wladder);
 
 			// Stop when there is a wall to the left or right.
 			IVec2 left, right;
@@ -567,12 +618,12 @@ void Blueprint::ladder(const IVec2 &init) {
 			if ((!is_tile_open(left) || !is_tile_open(right))) {
 				// Extra extension at top.
 				if (delta == -1) {
-					for (int extra = 1; extra <= max_obj.y; extra++) {
+					for (int extra = 1; extra <= MAX_OBJ_ROWS; extra++) {
 						IVec2 extraLoc;
 						extraLoc.x = loc.x;
 						extraLoc.y = loc.y - extra;
 						if (is_tile_open(extraLoc, true)) {
-							map[extraLoc.y][extraLoc.x] = Wladder;
+							set_tile(extraLoc, Wladder);
 						}
 						else {
 							break;
@@ -587,8 +638,11 @@ void Blueprint::ladder(const IVec2 &init) {
 	} // for delta
 }
 
-void Blueprint::extra_walls()
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+void BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::extra_walls()
 {
+	TRACE_SCOPE("Blueprint::extra_walls");
+
 	const float WALLS_PERCENT = 0.01;
 	const int MEAN_WALL_LENGTH = 30;
 
@@ -596,38 +650,34 @@ void Blueprint::extra_walls()
 	const int LADDER_CHANCE = 10;
 	const int UP_DOWN_CHANCE = 4;
 
-	for(int walls = 0; walls < dim.y * dim.x * WALLS_PERCENT; ++walls) {
+	// Walls start with space for the biggest object all around.
+	wallSpots.build(map, dim,
+		IVec2(2 * MAX_OBJ_COLS + 1, 2 * MAX_OBJ_ROWS + 1), Wempty);
+
+	for(int64_t walls = 0; walls < float(int64_t(dim.y) * dim.x) * WALLS_PERCENT;
+			++walls) {
+		// As often as a random start would have space around,
+		// pick one of the starts that do.
+		if (uniform_below(rng, uint64_t(dim.x) * dim.y) >= wallSpots.size()) {
+			continue;
+		}
 		bool ok = true;
-		IVec2 loc;
-		loc.y = std::uniform_int_distribution<>(0, dim.y - 1)(rand_gen);
-		loc.x = std::uniform_int_distribution<>(0, dim.x - 1)(rand_gen);
-		int delta = coin(rand_gen) ? 1 : -1;
-		int horiz = std::uniform_int_distribution<>(0, WALLS_HORIZ_CHANCE - 1)(rand_gen);
+		IVec2 loc = wallSpots.at(uniform_below(rng, wallSpots.size()))
+			+ IVec2(MAX_OBJ_COLS, MAX_OBJ_ROWS);
+		int delta = coin() ? 1 : -1;
+		int horiz = uniform_below(rng, WALLS_HORIZ_CHANCE);
 
 		IVec2 check;
-		for (check.x = loc.x - max_obj.x;
-				check.x <= loc.x + max_obj.x;
-				check.x++)
-		{
-			for (check.y = loc.y - max_obj.y;
-					check.y <= loc.y + max_obj.y;
-					check.y++)
-			{
-				if (!is_tile_open(check, true)) {
-					ok = false;
-				}
-			}
-		}
 
 		// Horizontal extra wall.
 		if (horiz) {
-			while (ok && std::uniform_int_distribution<>(0, MEAN_WALL_LENGTH - 1)(rand_gen)) {
+			while (ok && uniform_below(rng, MEAN_WALL_LENGTH)) {
 				for (check.x = loc.x;
-						check.x != loc.x + delta * (max_obj.x + 1);
+						check.x != loc.x + delta * (MAX_OBJ_COLS + 1);
 						check.x += delta)
 				{
-					for (check.y = loc.y - max_obj.y;
-							check.y <= loc.y + max_obj.y;
+					for (check.y = loc.y - MAX_OBJ_ROWS;
+							check.y <= loc.y + MAX_OBJ_ROWS;
 							check.y++)
 					{
 						if (!is_tile_open(check, true)) {
@@ -637,17 +687,17 @@ void Blueprint::extra_walls()
 				}
 
 				if (ok) {
-					if (!std::uniform_int_distribution<>(0, LADDER_CHANCE-1)(rand_gen)) {
+					if (!uniform_below(rng, LADDER_CHANCE)) {
 						ladder(loc);
 					}
 					else {
-						map[loc.y][loc.x] = Wwall;
+						set_tile(loc, Wwall);
 					}
 
 					loc.x += delta;
 
-					if (std::uniform_int_distribution<>(0, UP_DOWN_CHANCE-1)(rand_gen) == 0) {
-						loc.y += (coin(rand_gen) ? 1 : -1);
+					if (uniform_below(rng, UP_DOWN_CHANCE) == 0) {
+						loc.y += (coin() ? 1 : -1);
 					}
 				}
 			}
@@ -655,13 +705,13 @@ void Blueprint::extra_walls()
 
 		// Vertical wall, horiz == 0
 		else {
-			while (ok && std::uniform_int_distribution<>(0, MEAN_WALL_LENGTH - 1)(rand_gen)) {
+			while (ok && uniform_below(rng, MEAN_WALL_LENGTH)) {
 				for (check.y = loc.y;
-						check.y != loc.y + delta * (max_obj.y + 1);
+						check.y != loc.y + delta * (MAX_OBJ_ROWS + 1);
 						check.y += delta)
 				{
-					for (check.x = loc.x - max_obj.x;
-							check.x <= loc.x + max_obj.x;
+					for (check.x = loc.x - MAX_OBJ_COLS;
+							check.x <= loc.x + MAX_OBJ_COLS;
 							check.x++)
 					{
 						if (!is_tile_open(check, true)) {
@@ -670,14 +720,20 @@ void Blueprint::extra_walls()
 					}
 				}
 				if (ok) {
-					map[loc.y][loc.x] = Wwall;
+					set_tile(loc, Wwall);
 					loc.y += delta;
 				}
 			}
 		}
 	} // for walls.
+
+	wallSpots.clear();
 }
 
+template class BasicBlueprint<>;
+template class BasicBlueprint<26, 16, 2, 2, Xoshiro256, PackedTiles>;
+template class BasicBlueprint<26, 16, 2, 2, Xoshiro256, PagedTiles>;
+
 /*
 int main(int argc, char **argv)
 {
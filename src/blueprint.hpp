@@ -4,15 +4,17 @@
 
 #include <cstdint>
 #include <cstdlib>
-#include <random>
 #include "heapmatrix.hpp"
+#include "packedtiles.hpp"
+#include "pagedtiles.hpp"
 #include "vec2.hpp"
+#include "rng.hpp"
+#include "placement.hpp"
+#include "fenwick.hpp"
 
-class Blueprint {
+// What doesn't depend on the template parameters.
+class BlueprintBase {
 public:
-	Blueprint(size_t cols, size_t rows);
-	void dump(const char *filename);
-
 	enum Tiles {
 		Wempty,
 		Wwall,
@@ -21,13 +23,106 @@ public:
 		WmoverTrack,
 	};
 
-	HeapMatrix<uint8_t>& getMap()
+	static b2Vec2 toCoord(const IVec2& pos) {
+		return b2Vec2(pos.x, -pos.y);
+	}
+};
+
+// Level generator, drawing from a random Engine (see rng.hpp).
+// The same seed gives the same level on every standard library.
+//
+// Room size and the size of the biggest object in scene are known at
+// compile time, so the loops stamping rooms have constant bounds.
+//
+// Tiles are stored in a Map: a HeapMatrix<uint8_t>, PackedTiles, or
+// PagedTiles for maps bigger than memory. Generating those still takes
+// a bit per tile in memory, for the spots where movers and walls fit
+// (see PlacementIndex).
+// The map covers exactly the tiles asked for: rooms cut by its right
+// and bottom edges are stamped partially.
+template<int RoomCols = 26, int RoomRows = 16,
+	int ObjCols = 2, int ObjRows = 2, class Engine = Xoshiro256,
+	class Map = HeapMatrix<uint8_t> >
+class BasicBlueprint: public BlueprintBase {
+public:
+	typedef Map TileMap;
+
+	static constexpr int COLS_PER_ROOM = RoomCols;
+	static constexpr int ROWS_PER_ROOM = RoomRows;
+
+	// Biggest object in scene.
+	static constexpr int MAX_OBJ_COLS = ObjCols;
+	static constexpr int MAX_OBJ_ROWS = ObjRows;
+
+	static_assert(MAX_OBJ_COLS >= 2, "Movers shouldn't be too big");
+	static_assert(2 * (MAX_OBJ_COLS + 1) < COLS_PER_ROOM
+		&& 2 * (MAX_OBJ_ROWS + 1) < ROWS_PER_ROOM,
+		"Rooms must fit a ladder and a floor between objects");
+
+	BasicBlueprint(size_t cols, size_t rows, uint64_t seed = random_seed());
+
+	// Generate in an empty map set up beforehand, e.g. a PagedTiles
+	// file, of its size.
+	explicit BasicBlueprint(Map&& tiles, uint64_t seed = random_seed());
+	~BasicBlueprint();
+
+	// Maps are big, and a copy would go unaccounted.
+	BasicBlueprint(const BasicBlueprint&) = delete;
+	BasicBlueprint& operator=(const BasicBlueprint&) = delete;
+
+	void dump(const char *filename);
+
+	// Bytes held by the maps.
+	size_t memory() const
+	{
+		return map.bytes() + horiz.bytes() + vert.bytes();
+	}
+
+	Map& getMap()
 	{
 		return map;
 	}
 
-	static b2Vec2 toCoord(const IVec2& pos) {
-		return b2Vec2(pos.x, -pos.y);
+	const Map& getMap() const
+	{
+		return map;
+	}
+
+	IVec2 getMaxObj() const
+	{
+		return IVec2(MAX_OBJ_COLS, MAX_OBJ_ROWS);
+	}
+
+	// Room layout, see implement_rooms().
+	const IVec2& getRooms() const
+	{
+		return rooms;
+	}
+
+	// Whether there is a wall at the top of each room
+	// (plus the bottom of the last row of rooms).
+	const HeapMatrix<bool>& getHorizBounds() const
+	{
+		return horiz;
+	}
+
+	// Whether there is a wall at the left of each room
+	// (plus the right of the last column of rooms).
+	const HeapMatrix<bool>& getVertBounds() const
+	{
+		return vert;
+	}
+
+	// Where ladders go down each column of rooms, and
+	// where floors go across each row of rooms.
+	const std::vector<int>& getMiddleCols() const
+	{
+		return middleCols;
+	}
+
+	const std::vector<int>& getMiddleRows() const
+	{
+		return middleRows;
 	}
 
 private:
@@ -37,10 +132,35 @@ private:
 		uint16_t down;
 	};
 
+	// Min number of movers across a horizontal track must be.
+	static constexpr int MOVERS_HORIZ_MIN_TRACK = 6;
+
+	bool coin()
+	{
+		return uniform_below(rng, 2);
+	}
+
+	// Writes after implement_rooms() go through here, to keep the
+	// placement indices up to date.
+	void set_tile(const IVec2& loc, Tiles t)
+	{
+		const uint8_t old = map[loc.y][loc.x];
+		map[loc.y][loc.x] = t;
+		moverSpots.set_tile(loc, old, t);
+		wallSpots.set_tile(loc, old, t);
+	}
+
+	// Whether a vertical mover can replace the ladder in the
+	// middle of a room.
+	bool is_lift_room(const IVec2& room) const;
+
 	bool is_room_open(const RoomIndex & ri) const;
 	void fill_random();
 	void implement_rooms();
 
+	// Fill the tiles of [from, to) that are inside the map.
+	void stamp(IVec2 from, IVec2 to, Tiles t);
+
 	void has_right(const RoomIndex & ri, const IVec2 & rl);
 	void missing_right(const RoomIndex & ri, const IVec2 & rl);
 	void has_bottom(const RoomIndex & ri, const IVec2 & rl);
@@ -50,8 +170,8 @@ private:
 	void has_left(const RoomIndex & ri, const IVec2 & rl);
 	void missing_left(const RoomIndex & ri, const IVec2 & rl);
 
-	bool inside(const IVec2 &l);
-	bool inside(int r, int c);
+	bool inside(const IVec2 &l) const;
+	bool inside(int r, int c) const;
 	bool is_tile_open(const IVec2 &loc, bool laddersClosed=false,
 			bool postersClosed=false, bool doorsClosed=false, bool outsideClosed=true);
 	void add_movers();
@@ -61,20 +181,41 @@ private:
 	void ladder(const IVec2& init);
 	void extra_walls();
 
-	static const float ROWS_PER_ROOM;
-	static const float COLS_PER_ROOM;
-
 	IVec2 rooms;	// in rooms
 	IVec2 dim;		// in tiles
 
-	IVec2 max_obj;	// biggest object in scene
-
 	size_t moversNum;
 
 	HeapMatrix<bool> horiz, vert;
-	HeapMatrix<uint8_t> map;
+	Map map;
 	std::vector < int >middleCols, middleRows;
 
-	std::uniform_int_distribution<> coin;
+	// Where movers and extra walls fit, while they are added.
+	PlacementIndex moverSpots, wallSpots;
+	// Rooms whose middle is a ladder, by index down * rooms.x + across.
+	FenwickTree liftRooms;
+
+	Engine rng;
 };
 
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+constexpr int BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::COLS_PER_ROOM;
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+constexpr int BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::ROWS_PER_ROOM;
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+constexpr int BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::MAX_OBJ_COLS;
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+constexpr int BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::MAX_OBJ_ROWS;
+
+template<int RoomCols, int RoomRows, int ObjCols, int ObjRows, class Engine, class Map>
+constexpr int BasicBlueprint<RoomCols, RoomRows, ObjCols, ObjRows, Engine, Map>::MOVERS_HORIZ_MIN_TRACK;
+
+extern template class BasicBlueprint<>;
+typedef BasicBlueprint<> Blueprint;
+
+extern template class BasicBlueprint<26, 16, 2, 2, Xoshiro256, PackedTiles>;
+typedef BasicBlueprint<26, 16, 2, 2, Xoshiro256, PackedTiles> PackedBlueprint;
+
+extern template class BasicBlueprint<26, 16, 2, 2, Xoshiro256, PagedTiles>;
+typedef BasicBlueprint<26, 16, 2, 2, Xoshiro256, PagedTiles> PagedBlueprint;
+
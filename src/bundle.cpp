@@ -0,0 +1,141 @@
+#include "bundle.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
+
+const char* LevelBundle::GROUP = "Bundle";
+
+namespace {
+	const char* LEVEL_FILE = "/level.bin";
+
+	// Numbers are stored as they are in memory: bundles are baked on
+	// the kind of machine they are loaded on.
+	const char MAGIC[4] = {'N', 'S', 'A', 'B'};
+	const uint32_t VERSION = 1;
+
+	template<class T>
+	void put(std::ostream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof value);
+	}
+
+	template<class T>
+	void put_array(std::ostream& out, const std::vector<T>& values)
+	{
+		put(out, uint64_t(values.size()));
+		if(!values.empty())
+			out.write(reinterpret_cast<const char*>(values.data()),
+				values.size() * sizeof(T));
+	}
+
+	template<class T>
+	bool get(std::istream& in, T& value)
+	{
+		return bool(in.read(reinterpret_cast<char*>(&value), sizeof value));
+	}
+
+	template<class T>
+	bool get_array(std::istream& in, std::vector<T>& values, uint64_t max)
+	{
+		uint64_t size;
+		if(!get(in, size) || size > max)
+			return false;
+		values.resize(size);
+		return size == 0 || in.read(reinterpret_cast<char*>(values.data()),
+			size * sizeof(T));
+	}
+}
+
+std::string LevelBundle::chunk_mesh(int row, int col)
+{
+	return "chunk-" + std::to_string(row) + "-" + std::to_string(col) + ".mesh";
+}
+
+uint64_t LevelBundle::tiles_checksum(const HeapMatrix<uint8_t>& map,
+		int cols, int rows)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325u;
+	for(int i = 0; i < rows; ++i) {
+		for(int j = 0; j < cols; ++j) {
+			hash ^= map[i][j];
+			hash *= 0x100000001b3u;
+		}
+	}
+	return hash;
+}
+
+bool LevelBundle::write(const std::string& dir) const
+{
+	if(mkdir(dir.c_str(), 0755) && errno != EEXIST)
+		return false;
+
+	std::ofstream out(dir + LEVEL_FILE, std::ios::binary);
+	out.write(MAGIC, sizeof MAGIC);
+	put(out, VERSION);
+	put(out, cols);
+	put(out, rows);
+	put(out, seed);
+	put(out, checksum);
+
+	put(out, uint32_t(chunks.numRows()));
+	put(out, uint32_t(chunks.numCols()));
+	for(size_t i = 0; i < chunks.numRows(); ++i)
+		out.write(reinterpret_cast<const char*>(&chunks[i][0]), chunks.numCols());
+
+	put_array(out, loopVertices);
+	put_array(out, loopEdges);
+	put_array(out, vertices);
+	put_array(out, edges);
+
+	out.close();
+	return bool(out);
+}
+
+bool LevelBundle::read(const std::string& dir)
+{
+	std::ifstream in(dir + LEVEL_FILE, std::ios::binary);
+	char magic[sizeof MAGIC];
+	uint32_t version;
+	if(!in.read(magic, sizeof magic)
+			|| !std::equal(magic, magic + sizeof magic, MAGIC)
+			|| !get(in, version) || version != VERSION
+			|| !get(in, cols) || !get(in, rows)
+			|| !get(in, seed) || !get(in, checksum))
+		return false;
+
+	uint32_t chunk_rows, chunk_cols;
+	if(!get(in, chunk_rows) || !get(in, chunk_cols)
+			|| !chunk_rows || !chunk_cols
+			|| uint64_t(chunk_rows) * chunk_cols > uint64_t(rows) * cols)
+		return false;
+	chunks.resize(chunk_rows, chunk_cols, 0);
+	for(size_t i = 0; i < chunks.numRows(); ++i)
+		if(!in.read(reinterpret_cast<char*>(&chunks[i][0]), chunks.numCols()))
+			return false;
+
+	// Nothing comes more than four times per tile.
+	const uint64_t max = uint64_t(rows + 1) * (cols + 1) * 4;
+	if(!get_array(in, loopVertices, max) || !get_array(in, loopEdges, max)
+			|| loopVertices.size() != loopEdges.size()
+			|| !get_array(in, vertices, max) || !get_array(in, edges, max))
+		return false;
+
+	// Loops cover the flat arrays exactly.
+	int64_t total_vertices = 0, total_edges = 0;
+	for(size_t i = 0; i < loopVertices.size(); ++i) {
+		if(loopVertices[i] < 3 || loopEdges[i] < 1)
+			return false;
+		total_vertices += loopVertices[i];
+		total_edges += loopEdges[i];
+	}
+	if(total_vertices != int64_t(vertices.size())
+			|| total_edges != int64_t(edges.size()))
+		return false;
+	for(int32_t e: edges)
+		if(e < 0 || e >= int64_t(rows) * cols * 4)
+			return false;
+	return true;
+}
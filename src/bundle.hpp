@@ -0,0 +1,49 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "heapmatrix.hpp"
+
+// A Level baked offline (see Level::bake()), so that loading it doesn't
+// rebuild the scene and trace the collision loops again.
+//
+// A bundle is a directory holding a render mesh per chunk of the level
+// that has any tile, in Ogre's .mesh format, and a file with everything
+// else: how to generate the tiles again, and the collision loops, in
+// flat arrays ready to be handed to Box2D.
+struct LevelBundle
+{
+	uint16_t cols = 0, rows = 0;
+	uint64_t seed = 0;
+	// Of the tiles, to tell when the generator no longer gives the
+	// ones that were baked.
+	uint64_t checksum = 0;
+
+	// Whether each chunk has a mesh, by chunk row and column.
+	HeapMatrix<uint8_t> chunks;
+
+	// Loop i has loopVertices[i] of vertices, and goes along
+	// loopEdges[i] of edges, following the ones of loop i - 1. Edges
+	// are open tile sides, tile index * 4 + side.
+	std::vector<int32_t> loopVertices, loopEdges;
+	std::vector<b2Vec2> vertices;
+	std::vector<int32_t> edges;
+
+	// Resource group the chunk meshes are loaded in.
+	static const char* GROUP;
+
+	// File name of the mesh of a chunk, in the bundle directory.
+	static std::string chunk_mesh(int row, int col);
+
+	static uint64_t tiles_checksum(const HeapMatrix<uint8_t>& map,
+		int cols, int rows);
+
+	// Write all but the meshes to dir, creating it if needed.
+	bool write(const std::string& dir) const;
+
+	// Read what write() wrote, false if missing or inconsistent.
+	bool read(const std::string& dir);
+};
@@ -0,0 +1,82 @@
+#include "characters.hpp"
+#include "blueprint.hpp"
+#include "trace.hpp"
+
+Characters::Characters(Actors& actors):
+	mActors(actors)
+{}
+
+Characters::Id Characters::spawn(const b2Vec2& position,
+		const b2Vec2& half_size, float speed, const Ogre::String& mesh,
+		const Ogre::String& material)
+{
+	b2BodyDef body;
+	body.type = b2_dynamicBody;
+	body.position = position;
+	body.fixedRotation = true;
+	body.linearVelocity = b2Vec2(speed, 0);
+
+	b2PolygonShape box;
+	box.SetAsBox(half_size.x, half_size.y);
+	b2FixtureDef fixture;
+	fixture.shape = &box;
+	fixture.density = 1;
+	fixture.filter.maskBits = ~WALLS;
+
+	const Id id = mActors.spawn(body, fixture, mesh, material);
+	mIds.push_back(id);
+	mHalfSizes.push_back(half_size);
+	mPositions.push_back(position);
+	mSpeeds.push_back(speed);
+	mGrounded.push_back(false);
+	return id;
+}
+
+void Characters::resolve(const GridQuery& grid)
+{
+	TRACE_SCOPE("Characters::resolve");
+
+	const uint32_t walls = GridQuery::tile_mask(Blueprint::Wwall);
+	const size_t count = size();
+	for(size_t i = 0; i < count; ++i) {
+		b2Body* body = mActors.body(mIds[i]);
+		const b2Vec2 from = mPositions[i];
+		const b2Vec2 to = body->GetPosition();
+
+		b2AABB box;
+		box.lowerBound = from - mHalfSizes[i];
+		box.upperBound = from + mHalfSizes[i];
+		const GridQuery::Sweep sweep = grid.sweep(box, to - from, walls);
+
+		// Walking on, or turning back
+		b2Vec2 velocity = body->GetLinearVelocity();
+		if(sweep.stopped_x)
+			mSpeeds[i] = -mSpeeds[i];
+		velocity.x = mSpeeds[i];
+		if(sweep.stopped_y)
+			velocity.y = 0;
+		mGrounded[i] = sweep.stopped_y && sweep.delta.y > to.y - from.y;
+		body->SetLinearVelocity(velocity);
+
+		if(sweep.stopped_x || sweep.stopped_y) {
+			mPositions[i] = from + sweep.delta;
+			body->SetTransform(mPositions[i], 0);
+		} else {
+			mPositions[i] = to;
+		}
+	}
+}
+
+void Characters::save(Snapshot& snapshot) const
+{
+	snapshot.write(mPositions);
+	snapshot.write(mSpeeds);
+	snapshot.write(mGrounded);
+}
+
+void Characters::load(Snapshot& snapshot)
+{
+	snapshot.read(mPositions);
+	snapshot.read(mSpeeds);
+	snapshot.read(mGrounded);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <vector>
+#include <cstdint>
+#include "actors.hpp"
+#include "gridquery.hpp"
+#include "snapshot.hpp"
+
+// Actors shaped as boxes that walk the level, kept out of the walls by
+// the tile map instead of by Box2D.
+//
+// Their fixtures don't collide with the chain loops around the walls
+// (WALLS category), so Box2D only handles contacts with other bodies:
+// actors, movers. After each step, the move Box2D made is swept against
+// the wall tiles, stopping at the first one, which is a few tile reads
+// instead of contacts with loops spanning the whole level.
+//
+// For now characters walk at their speed and turn back at walls.
+class Characters
+{
+public:
+	typedef Actors::Id Id;
+
+	// Fixture category of the walls of the level.
+	static const uint16_t WALLS = 0x0002;
+
+	explicit Characters(Actors& actors);
+
+	Characters(const Characters&) = delete;
+	Characters& operator=(const Characters&) = delete;
+
+	// Centered at position in world coordinates, of half the size
+	// given, walking at speed, negative to the left.
+	Id spawn(const b2Vec2& position, const b2Vec2& half_size, float speed,
+		const Ogre::String& mesh, const Ogre::String& material);
+
+	// Stop the moves since the last call at the walls of grid. To be
+	// called after each physics step, before syncing the actors.
+	void resolve(const GridQuery& grid);
+
+	// What isn't in the bodies, saved apart.
+	void save(Snapshot& snapshot) const;
+	void load(Snapshot& snapshot);
+
+	size_t size() const
+	{
+		return mIds.size();
+	}
+
+	// Whether a character stood on a wall as of the last resolve().
+	bool grounded(size_t i) const
+	{
+		return mGrounded[i];
+	}
+
+	Id id(size_t i) const
+	{
+		return mIds[i];
+	}
+
+private:
+	Actors& mActors;
+
+	// Per character, indexed alike:
+	std::vector<Id> mIds;
+	std::vector<b2Vec2> mHalfSizes;
+	std::vector<b2Vec2> mPositions;	// as of the last resolve()
+	std::vector<float> mSpeeds;
+	std::vector<uint8_t> mGrounded;
+};
@@ -0,0 +1,160 @@
+#include "circuit.hpp"
+#include "trace.hpp"
+
+#include <cassert>
+
+const IVec2 CircuitBase::FACING[4] = {
+	IVec2(0, 1),
+	IVec2(-1, 0),
+	IVec2(0, -1),
+	IVec2(1, 0)
+};
+
+const b2Vec2 CircuitBase::OFFSET[4] = {
+	b2Vec2(-0.5, -0.5),
+	b2Vec2(-0.5, 0.5),
+	b2Vec2(0.5, 0.5),
+	b2Vec2(0.5, -0.5)
+};
+
+const IVec2 CircuitBase::OPPOSITE[4] = {
+	IVec2(-1, 1),
+	IVec2(-1, -1),
+	IVec2(1, -1),
+	IVec2(1, 1)
+};
+
+template<class Map>
+BasicCircuit<Map>::BasicCircuit(const Map& map, HeapMatrix<uint32_t>& owners,
+		uint32_t id, const IVec2& max, IVec2 cur, Side s):
+	mMax(max),
+	mMap(map),
+	mOwners(owners),
+	mId(id),
+	mCur(cur)
+{
+	TRACE_SCOPE("Circuit::Circuit");
+
+	assert(edge(s, cur));
+
+	mark(s);
+	trace(s);
+}
+
+template<class Map>
+bool BasicCircuit<Map>::is_wall(const Map& map, const IVec2& max,
+		const IVec2& pos)
+{
+	// The map is closed: loops go around its border from outside.
+	if(pos.x < 0 || pos.y < 0 || pos.x >= max.x || pos.y >= max.y)
+		return true;
+	return static_cast<Blueprint::Tiles>(map[pos.y][pos.x]) == Blueprint::Wwall;
+}
+
+template<class Map>
+bool BasicCircuit<Map>::edge(const Map& map, const IVec2& max,
+		Side s, IVec2 pos)
+{
+	// We work under assumption this position is a wall...
+	assert(is_wall(map, max, pos));
+
+	// Displace pos to the relevant side:
+	switch(s)
+	{
+	case DOWN:
+		if(++pos.y >= max.y)
+			return false;
+		break;
+	case LEFT:
+		if(--pos.x < 0)
+			return false;
+		break;
+	case UP:
+		if(--pos.y < 0)
+			return false;
+		break;
+	case RIGHT:
+		if(++pos.x >= max.x)
+			return false;
+		break;
+	}
+
+	// If new position is not a wall, and previous was,
+	// we found an edge!
+	return !is_wall(map, max, pos);
+}
+
+template<class Map>
+IVec2 BasicCircuit<Map>::next_from(Side s) const
+{
+	IVec2 ret = mCur;
+	switch(s)
+	{
+	case DOWN:
+		--ret.x;
+		break;
+	case LEFT:
+		--ret.y;
+		break;
+	case UP:
+		++ret.x;
+		break;
+	case RIGHT:
+		++ret.y;
+		break;
+	}
+	return ret;
+}
+
+template<class Map>
+void BasicCircuit<Map>::mark(Side s)
+{
+	const IVec2 open = mCur + FACING[s];
+	mOwners[open.y][open.x * 4 + s] = mId;
+	mTiles.push_back(open.y * mMax.x + open.x);
+}
+
+template<class Map>
+void BasicCircuit<Map>::trace(Side s)
+{
+	// Each tile side on a loop leads to a single next one, so the loop
+	// is closed when it gets back to the first side. Not to the first
+	// vertex: loops go twice by vertices where walls touch diagonally.
+	const IVec2 start = mCur;
+	const Side start_side = s;
+	auto closed = [&]() {
+		return s == start_side && mCur == start;
+	};
+
+	for(;;) {
+		IVec2 next = next_from(s);
+		while(is_wall(next) && edge(s, next)) {
+			mCur = next;
+			if(closed())
+				return;
+			mark(s);
+			next = next_from(s);
+		}
+
+		mVertices.push_back(Blueprint::toCoord(mCur) + OFFSET[s]);
+
+		Side maybe_next_side = static_cast<Side>((s+1) % 4);
+		if(edge(maybe_next_side, mCur)) {
+			// The edge follows the same tile around, clockwise...
+			s = maybe_next_side;
+		} else {
+			// The edge follows counter-clockwise, on another
+			// tile diagonally touching the current one...
+			mCur += OPPOSITE[s];
+			s = static_cast<Side>((s+3) % 4);
+
+			assert(edge(s, mCur));
+		}
+		if(closed())
+			return;
+		mark(s);
+	}
+}
+
+template class BasicCircuit<Blueprint::TileMap>;
+template class BasicCircuit<PackedTiles>;
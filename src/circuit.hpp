@@ -0,0 +1,92 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <cstdint>
+#include <vector>
+#include "blueprint.hpp"
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+
+// What doesn't depend on how tiles are stored.
+class CircuitBase
+{
+public:
+	enum Side {
+		DOWN,
+		LEFT,
+		UP,
+		RIGHT
+	};
+
+	// Direction of each side.
+	static const IVec2 FACING[4];
+
+protected:
+	static const b2Vec2 OFFSET[4];
+	static const IVec2 OPPOSITE[4];
+};
+
+// A loop of collision edges around walls, traced on a tile Map (see
+// Blueprint).
+template<class Map>
+class BasicCircuit: public CircuitBase
+{
+public:
+	// Trace the loop going along side s of the wall tile cur, which
+	// may be outside the map. The loop owns the edges it goes along:
+	// their id is set in owners, on the open tile across each edge,
+	// which has a column per side of each map column.
+	BasicCircuit(const Map& map, HeapMatrix<uint32_t>& owners,
+		uint32_t id, const IVec2& max, IVec2 cur, Side s);
+
+	const std::vector<b2Vec2>& getPath() const
+	{
+		return mVertices;
+	}
+
+	// Indices (row * max.x + col) of the open tiles the loop goes
+	// along, possibly repeated.
+	const std::vector<int>& getTiles() const
+	{
+		return mTiles;
+	}
+
+	static bool is_wall(const Map& map, const IVec2& max, const IVec2& pos);
+
+	// Whether side s of a wall tile is part of a loop.
+	static bool edge(const Map& map, const IVec2& max, Side s, IVec2 pos);
+
+private:
+	bool is_wall(const IVec2& pos) const
+	{
+		return is_wall(mMap, mMax, pos);
+	}
+
+	bool edge(Side s, const IVec2& pos) const
+	{
+		return edge(mMap, mMax, s, pos);
+	}
+
+	IVec2 next_from(Side s) const;
+	void mark(Side s);
+
+	void trace(Side s);
+
+	const IVec2& mMax;
+	const Map& mMap;
+	HeapMatrix<uint32_t>& mOwners;
+	uint32_t mId;
+	std::vector<b2Vec2> mVertices;
+	std::vector<int> mTiles;
+
+	IVec2 mCur;
+};
+
+// Level traces the map of its Blueprint; packed maps can be traced too.
+// Paged ones can't: the owners, four words per tile, take more memory
+// than the map itself.
+extern template class BasicCircuit<Blueprint::TileMap>;
+typedef BasicCircuit<Blueprint::TileMap> Circuit;
+
+extern template class BasicCircuit<PackedTiles>;
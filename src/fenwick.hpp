@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+// Counts for a range of indices (a Fenwick tree): changing one and
+// finding where the running total reaches a value both take O(log n),
+// so that picking the k-th of a changing set of items doesn't get
+// slower with the number of items.
+class FenwickTree
+{
+public:
+	FenwickTree() = default;
+
+	// n counts, all zero.
+	void assign(size_t n)
+	{
+		mTree.assign(n, 0);
+		mTotal = 0;
+		mStep = 1;
+		while(mStep * 2 <= n)
+			mStep *= 2;
+	}
+
+	// The given counts, in O(n).
+	void assign(const std::vector<int64_t>& counts)
+	{
+		assign(counts.size());
+		mTree = counts;
+		for(size_t i = 1; i <= mTree.size(); ++i) {
+			mTotal += counts[i - 1];
+			const size_t parent = i + (i & -i);
+			if(parent <= mTree.size())
+				mTree[parent - 1] += mTree[i - 1];
+		}
+	}
+
+	void clear()
+	{
+		assign(0);
+	}
+
+	void add(size_t i, int64_t delta)
+	{
+		assert(i < mTree.size());
+		mTotal += delta;
+		for(++i; i <= mTree.size(); i += i & -i)
+			mTree[i - 1] += delta;
+	}
+
+	int64_t total() const
+	{
+		return mTotal;
+	}
+
+	// Sum of the first n counts.
+	int64_t prefix(size_t n) const
+	{
+		assert(n <= mTree.size());
+		int64_t sum = 0;
+		for(; n; n -= n & -n)
+			sum += mTree[n - 1];
+		return sum;
+	}
+
+	int64_t count(size_t i) const
+	{
+		return prefix(i + 1) - prefix(i);
+	}
+
+	// Index whose count holds the k-th unit, k < total(), lowering k
+	// by the counts of the indices before it.
+	size_t find(int64_t& k) const
+	{
+		assert(k >= 0 && k < mTotal);
+		size_t i = 0;
+		for(size_t step = mStep; step; step /= 2) {
+			if(i + step <= mTree.size() && mTree[i + step - 1] <= k) {
+				i += step;
+				k -= mTree[i - 1];
+			}
+		}
+		return i;
+	}
+
+private:
+	// Entry i holds the sum of counts [i + 1 - lowbit(i + 1), i].
+	std::vector<int64_t> mTree;
+	int64_t mTotal = 0;
+	// Highest power of two not above the number of counts.
+	size_t mStep = 0;
+};
@@ -0,0 +1,238 @@
+#include "flowfield.hpp"
+#include "trace.hpp"
+#include "jobs.hpp"
+
+#include <limits>
+#include <algorithm>
+
+const int32_t FlowField::UNREACHABLE = std::numeric_limits<int32_t>::max();
+
+namespace {
+	const IVec2 NEIGHBOURS[4] = {
+		IVec2(0, 1),
+		IVec2(-1, 0),
+		IVec2(0, -1),
+		IVec2(1, 0)
+	};
+
+	// Below this many tiles, threads cost more than they save.
+	const int PARALLEL_MIN_TILES = 1 << 16;
+
+	// Narrowest band of columns given to a thread.
+	const int MIN_BAND_COLS = 64;
+
+	// Goals moving farther than this cause a full recompute.
+	const int32_t MAX_GOAL_STEP = 8;
+}
+
+FlowField::FlowField(const HeapMatrix<uint8_t>& map, const IVec2& dim):
+	mTraversal(map, dim),
+	mDim(dim),
+	mDist(dim.x * dim.y, UNREACHABLE),
+	mBias(0)
+{}
+
+void FlowField::set_goals(const std::vector<IVec2>& goals)
+{
+	mGoals = goals;
+	recompute();
+}
+
+void FlowField::add_goal(const IVec2& goal)
+{
+	mGoals.push_back(goal);
+	if(!mTraversal.passable(goal.y, goal.x))
+		return;
+
+	mSeeds.assign(1, Seed(0, index(goal)));
+	relax(mSeeds, 0, mDim.x, mOut, mQueue);
+}
+
+void FlowField::move_goal(size_t i, const IVec2& goal)
+{
+	const IVec2 old = mGoals[i];
+	mGoals[i] = goal;
+
+	// Going from the old goal to the new one takes k moves, so no tile
+	// is more than k moves farther from the goals than it was. Raising
+	// every distance by k, then lowering them from the goals gives the
+	// exact field, touching only the tiles that got closer: with a
+	// single goal, about the half of the map it moved towards.
+	const int32_t k = walk(old, goal, MAX_GOAL_STEP);
+	if(k < 0 || mBias > UNREACHABLE / 2) {
+		recompute();
+		return;
+	}
+
+	mBias += k;
+	mSeeds.clear();
+	for(const IVec2& g: mGoals)
+		if(mTraversal.passable(g.y, g.x))
+			mSeeds.push_back(Seed(0, index(g)));
+	relax(mSeeds, 0, mDim.x, mOut, mQueue);
+}
+
+void FlowField::recompute()
+{
+	mBias = 0;
+	std::fill(mDist.begin(), mDist.end(), UNREACHABLE);
+	wavefront();
+}
+
+IVec2 FlowField::direction(const IVec2& tile) const
+{
+	IVec2 best(0, 0);
+	int32_t best_dist = distance(tile);
+	for(const IVec2& delta: NEIGHBOURS) {
+		IVec2 n = tile + delta;
+		if(!mTraversal.can_move(tile, n))
+			continue;
+
+		int32_t d = distance(n);
+		if(d < best_dist) {
+			best_dist = d;
+			best = delta;
+		}
+	}
+	return best;
+}
+
+int32_t FlowField::walk(const IVec2& from, const IVec2& to, int32_t limit) const
+{
+	if(!mTraversal.passable(from.y, from.x) || !mTraversal.passable(to.y, to.x))
+		return -1;
+	if(from == to)
+		return 0;
+
+	// Breadth first within limit tiles around from.
+	const int side = 2 * limit + 1;
+	auto local = [&](const IVec2& t) {
+		int x = t.x - from.x + limit;
+		int y = t.y - from.y + limit;
+		return (x < 0 || y < 0 || x >= side || y >= side) ? -1 : y * side + x;
+	};
+	if(local(to) < 0)
+		return -1;
+
+	std::vector<int32_t> dist(side * side, -1);
+	std::vector<IVec2> queue(1, from);
+	dist[local(from)] = 0;
+	for(size_t head = 0; head < queue.size(); ++head) {
+		const IVec2 t = queue[head];
+		const int32_t d = dist[local(t)];
+		if(d == limit)
+			break;
+
+		for(const IVec2& delta: NEIGHBOURS) {
+			IVec2 n = t + delta;
+			int l = local(n);
+			if(l < 0 || dist[l] >= 0 || !mTraversal.can_move(t, n))
+				continue;
+			if(n == to)
+				return d + 1;
+			dist[l] = d + 1;
+			queue.push_back(n);
+		}
+	}
+	return -1;
+}
+
+void FlowField::relax(std::vector<Seed>& seeds, int x0, int x1,
+		std::vector<Seed>& out, std::vector<Seed>& queue)
+{
+	seeds.erase(std::remove_if(seeds.begin(), seeds.end(),
+		[&](const Seed& s) { return s.first >= get(s.second); }),
+		seeds.end());
+	for(const Seed& s: seeds)
+		set(s.second, s.first);
+	std::sort(seeds.begin(), seeds.end());
+
+	// Seeds are sorted, and moves all cost the same, so the queue is
+	// sorted as well: merging both visits tiles in order of distance.
+	// Entries whose tile got closer since they were queued are stale.
+	queue.clear();
+	size_t s = 0, head = 0;
+	while(s < seeds.size() || head < queue.size()) {
+		const bool seed = head == queue.size()
+			|| (s < seeds.size() && seeds[s].first <= queue[head].first);
+		const Seed cur = seed ? seeds[s++] : queue[head++];
+		if(cur.first != get(cur.second))
+			continue;
+
+		const IVec2 t(cur.second % mDim.x, cur.second / mDim.x);
+		const int32_t d = cur.first + 1;
+		for(const IVec2& delta: NEIGHBOURS) {
+			IVec2 n = t + delta;
+			if(!mTraversal.passable(n.y, n.x) || !mTraversal.can_move(n, t))
+				continue;
+
+			const int i = index(n);
+			if(n.x < x0 || n.x >= x1) {
+				out.push_back(Seed(d, i));
+			} else if(d < get(i)) {
+				set(i, d);
+				queue.push_back(Seed(d, i));
+			}
+		}
+	}
+}
+
+void FlowField::wavefront()
+{
+	TRACE_SCOPE("FlowField::wavefront");
+
+	JobSystem& jobs = JobSystem::get();
+	int bands = 1;
+	if(mDim.x * mDim.y >= PARALLEL_MIN_TILES) {
+		bands = std::min<int>(jobs.workers() + 1, mDim.x / MIN_BAND_COLS);
+		bands = std::max(bands, 1);
+	}
+	auto band_start = [&](int b) {
+		return mDim.x * b / bands;
+	};
+	auto band_of = [&](int col) {
+		int b = col * bands / mDim.x;
+		while(col < band_start(b))
+			--b;
+		while(col >= band_start(b + 1))
+			++b;
+		return b;
+	};
+
+	std::vector<std::vector<Seed> > inbox(bands), outbox(bands);
+	for(const IVec2& g: mGoals)
+		if(mTraversal.passable(g.y, g.x))
+			inbox[band_of(g.x)].push_back(Seed(0, index(g)));
+
+	if(bands == 1) {
+		relax(inbox[0], 0, mDim.x, outbox[0], mQueue);
+		return;
+	}
+
+	// Each band is relaxed on its own, in a job, then the moves
+	// crossing into the neighbouring bands seed the next round, until
+	// none is left.
+	std::vector<std::vector<Seed> > queues(bands);
+	std::vector<JobSystem::Job> round(bands);
+	for(;;) {
+		for(int b = 0; b < bands; ++b) {
+			round[b] = jobs.add([&, b]() {
+				TRACE_SCOPE("FlowField::relax");
+				outbox[b].clear();
+				relax(inbox[b], band_start(b), band_start(b + 1), outbox[b], queues[b]);
+			});
+		}
+		jobs.wait(round);
+
+		bool done = true;
+		for(auto& in: inbox)
+			in.clear();
+		for(auto& out: outbox) {
+			for(const Seed& s: out)
+				inbox[band_of(s.second % mDim.x)].push_back(s);
+			done = done && out.empty();
+		}
+		if(done)
+			return;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+#include "traversal.hpp"
+
+// Distance to the nearest of a set of goals, for every tile of the map
+// (a Dijkstra map), following Traversal rules. Agents chasing the goals
+// just step in direction() from wherever they are, in O(1), instead of
+// searching a path each.
+//
+// Recomputing the whole field is a breadth first wavefront, split in
+// bands of columns run as separate jobs on big maps. Moving a goal
+// a few tiles only revisits the tiles whose distance went down.
+//
+// The field reads the map, but isn't told when it changes: those of a
+// level are made by Level::add_flow_field(), which recomputes them.
+class FlowField
+{
+public:
+	static const int32_t UNREACHABLE;
+
+	// Only the first dim.y rows and dim.x columns of map are used.
+	FlowField(const HeapMatrix<uint8_t>& map, const IVec2& dim);
+
+	// Replace the goals, recomputing the whole field.
+	void set_goals(const std::vector<IVec2>& goals);
+
+	// Add a goal, updating only the tiles that got closer to a goal.
+	void add_goal(const IVec2& goal);
+
+	// Move the i-th goal, updating incrementally when it moves by a
+	// few tiles, recomputing everything otherwise.
+	void move_goal(size_t i, const IVec2& goal);
+
+	// Tiles changed, recompute the whole field.
+	void recompute();
+
+	const std::vector<IVec2>& getGoals() const
+	{
+		return mGoals;
+	}
+
+	// Moves from a tile to its nearest goal, or UNREACHABLE.
+	int32_t distance(const IVec2& tile) const
+	{
+		return get(index(tile));
+	}
+
+	// Step to take from a tile towards its nearest goal, (0, 0) at
+	// a goal or where no goal can be reached.
+	IVec2 direction(const IVec2& tile) const;
+
+private:
+	// A distance for a tile index.
+	typedef std::pair<int32_t, int> Seed;
+
+	int index(const IVec2& tile) const
+	{
+		return tile.y * mDim.x + tile.x;
+	}
+
+	int32_t get(int i) const
+	{
+		return mDist[i] == UNREACHABLE ? UNREACHABLE : mDist[i] + mBias;
+	}
+
+	void set(int i, int32_t d)
+	{
+		mDist[i] = d - mBias;
+	}
+
+	// Moves needed from one tile to another, -1 if more than limit.
+	int32_t walk(const IVec2& from, const IVec2& to, int32_t limit) const;
+
+	// Lower distances from the seeds, in order of distance, within
+	// columns [x0, x1). Moves reaching other columns are added to out.
+	void relax(std::vector<Seed>& seeds, int x0, int x1,
+		std::vector<Seed>& out, std::vector<Seed>& queue);
+
+	void wavefront();
+
+	Traversal mTraversal;
+	IVec2 mDim;
+	std::vector<IVec2> mGoals;
+
+	// Stored distances are mBias less than the real ones, so that
+	// they can all be raised at once.
+	std::vector<int32_t> mDist;
+	int32_t mBias;
+
+	std::vector<Seed> mSeeds, mQueue, mOut;
+};
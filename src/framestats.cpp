@@ -0,0 +1,122 @@
+#include "framestats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+Histogram::Histogram(double width):
+	mWidth(width),
+	mBuckets(),
+	mCount(0),
+	mSum(0),
+	mMax(0)
+{}
+
+void Histogram::add(double value)
+{
+	const int b = std::min<double>(std::max(value, 0.0) / mWidth, BUCKETS - 1);
+	++mBuckets[b];
+	++mCount;
+	mSum += value;
+	mMax = std::max(mMax, value);
+}
+
+double Histogram::percentile(double p) const
+{
+	const double wanted = p * mCount;
+	uint32_t below = 0;
+	for(int b = 0; b < BUCKETS - 1; ++b) {
+		below += mBuckets[b];
+		if(below >= wanted)
+			return std::min((b + 1) * mWidth, mMax);
+	}
+	return mMax;
+}
+
+FrameStats::FrameStats(Ogre::RenderTarget* target, Ogre::SceneManager* sm,
+		float budget, const char* csv_file):
+	mTarget(target),
+	mSceneMgr(sm),
+	mBudget(budget),
+	mStarted(false),
+	mOverBudget(0),
+	mPhysicsTime(0),
+	mRenderables(0),
+	mFrameMs(0.1),
+	mPhysicsMs(0.01),
+	mRenderablesHist(8),
+	mBatches(4)
+{
+	mSceneMgr->addRenderObjectListener(this);
+
+	if(csv_file) {
+		mCsv.open(csv_file);
+		mCsv << "frame_ms,physics_ms,renderables,batches\n";
+	}
+}
+
+FrameStats::~FrameStats()
+{
+	mSceneMgr->removeRenderObjectListener(this);
+}
+
+bool FrameStats::frameEnded(const Ogre::FrameEvent& evt)
+{
+	const double frame_ms = evt.timeSinceLastFrame * 1000.0;
+	const double physics_ms = mPhysicsTime * 1000.0;
+	const size_t batches = mTarget->getBatchCount();
+
+	if(mStarted) {
+		mFrameMs.add(frame_ms);
+		mPhysicsMs.add(physics_ms);
+		mRenderablesHist.add(mRenderables);
+		mBatches.add(batches);
+		if(evt.timeSinceLastFrame > mBudget)
+			++mOverBudget;
+
+		if(mCsv.is_open())
+			mCsv << frame_ms << ',' << physics_ms << ','
+				<< mRenderables << ',' << batches << '\n';
+	}
+
+	mStarted = true;
+	mPhysicsTime = 0;
+	mRenderables = 0;
+	return true;
+}
+
+void FrameStats::notifyRenderSingleObject(Ogre::Renderable*,
+		const Ogre::Pass*, const Ogre::AutoParamDataSource*,
+		const Ogre::LightList*, bool)
+{
+	++mRenderables;
+}
+
+void FrameStats::report(std::ostream& out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out << "Frames: " << mFrameMs.count()
+		<< ", over budget (" << mBudget * 1000.0f << " ms): " << mOverBudget
+		<< '\n' << std::setw(12) << ""
+		<< std::setw(10) << "mean" << std::setw(10) << "p50"
+		<< std::setw(10) << "p95" << std::setw(10) << "p99"
+		<< std::setw(10) << "max" << '\n';
+
+	auto row = [&](const char* name, const Histogram& h) {
+		out << std::left << std::setw(12) << name << std::right
+			<< std::fixed << std::setprecision(2)
+			<< std::setw(10) << h.mean()
+			<< std::setw(10) << h.percentile(0.50)
+			<< std::setw(10) << h.percentile(0.95)
+			<< std::setw(10) << h.percentile(0.99)
+			<< std::setw(10) << h.max() << '\n';
+	};
+	row("frame ms", mFrameMs);
+	row("physics ms", mPhysicsMs);
+	row("renderables", mRenderablesHist);
+	row("batches", mBatches);
+	out.flags(flags);
+	out.precision(precision);
+	out.flush();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+
+// Distribution of a value, counted in fixed width buckets starting at
+// zero, the last one taking everything above. Adding a sample never
+// allocates.
+class Histogram
+{
+public:
+	static const int BUCKETS = 1024;
+
+	explicit Histogram(double width);
+
+	void add(double value);
+
+	// Value below which a fraction p of the samples fall, rounded up
+	// to a bucket bound.
+	double percentile(double p) const;
+
+	uint32_t count() const
+	{
+		return mCount;
+	}
+
+	double mean() const
+	{
+		return mCount ? mSum / mCount : 0;
+	}
+
+	double max() const
+	{
+		return mMax;
+	}
+
+private:
+	double mWidth;
+	uint32_t mBuckets[BUCKETS];
+	uint32_t mCount;
+	double mSum;
+	double mMax;
+};
+
+// Frame time, physics step time, rendered objects and batches, for
+// every frame. Registered as a frame listener of the root and a render
+// object listener of the scene manager, it samples each frame as it
+// ends; time spent in physics is given by whoever steps it.
+class FrameStats:
+	public Ogre::FrameListener,
+	public Ogre::RenderObjectListener
+{
+public:
+	// Frames taking longer than budget seconds are counted as over
+	// budget. Each frame is also written as a line of csv_file, unless
+	// it is null.
+	FrameStats(Ogre::RenderTarget* target, Ogre::SceneManager* sm,
+		float budget, const char* csv_file = nullptr);
+	~FrameStats();
+
+	FrameStats(const FrameStats&) = delete;
+	FrameStats& operator=(const FrameStats&) = delete;
+
+	// Time spent stepping physics in the current frame.
+	void add_physics_time(double seconds)
+	{
+		mPhysicsTime += seconds;
+	}
+
+	// Percentiles of everything sampled so far.
+	void report(std::ostream& out) const;
+
+	bool frameEnded(const Ogre::FrameEvent& evt);
+
+	void notifyRenderSingleObject(Ogre::Renderable* rend,
+		const Ogre::Pass* pass, const Ogre::AutoParamDataSource* source,
+		const Ogre::LightList* lights, bool suppress_render_state);
+
+private:
+	Ogre::RenderTarget* mTarget;
+	Ogre::SceneManager* mSceneMgr;
+	float mBudget;
+	std::ofstream mCsv;
+
+	// The first frame also counts the time taken to set up.
+	bool mStarted;
+	uint32_t mOverBudget;
+	double mPhysicsTime;
+	uint32_t mRenderables;
+
+	// Frame and physics times in milliseconds.
+	Histogram mFrameMs;
+	Histogram mPhysicsMs;
+	Histogram mRenderablesHist;
+	Histogram mBatches;
+};
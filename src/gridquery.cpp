@@ -0,0 +1,214 @@
+#include "gridquery.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "blueprint.hpp"
+
+namespace {
+	// Overlaps of boxes with tiles smaller than this, in tiles, are
+	// taken as rounding errors.
+	const float SKIN = 1e-4f;
+
+	// One Liang-Barsky clipping plane: p is the projection of the
+	// segment on the plane normal, q the distance from the start.
+	bool clip(float p, float q, float& t0, float& t1)
+	{
+		if(p == 0)
+			return q >= 0;
+
+		float r = q / p;
+		if(p < 0) {
+			if(r > t1)
+				return false;
+			t0 = std::max(t0, r);
+		} else {
+			if(r < t0)
+				return false;
+			t1 = std::min(t1, r);
+		}
+		return true;
+	}
+}
+
+bool GridQuery::raycast(const b2Vec2& from, const b2Vec2& to, uint32_t mask,
+		Hit& hit) const
+{
+	hit.hit = false;
+
+	const b2Vec2 g0 = to_grid(from);
+	const b2Vec2 d = to_grid(to) - g0;
+
+	// Outside of the map never stops a ray, so only the
+	// part of the segment inside it is walked.
+	float t0 = 0, t1 = 1;
+	if(!clip(-d.x, g0.x, t0, t1) || !clip(d.x, mDim.x - g0.x, t0, t1)
+			|| !clip(-d.y, g0.y, t0, t1) || !clip(d.y, mDim.y - g0.y, t0, t1))
+		return false;
+
+	IVec2 cell(std::floor(g0.x + t0 * d.x), std::floor(g0.y + t0 * d.y));
+	cell.x = std::min(std::max(cell.x, 0), mDim.x - 1);
+	cell.y = std::min(std::max(cell.y, 0), mDim.y - 1);
+
+	// Ray parameter where the next vertical and horizontal tile
+	// boundaries are crossed, and how much it takes to cross one tile.
+	const float inf = std::numeric_limits<float>::infinity();
+	const IVec2 step(d.x > 0 ? 1 : -1, d.y > 0 ? 1 : -1);
+	float next_x = inf, next_y = inf;
+	float delta_x = inf, delta_y = inf;
+	if(d.x != 0) {
+		next_x = (cell.x + (step.x > 0) - g0.x) / d.x;
+		delta_x = step.x / d.x;
+	}
+	if(d.y != 0) {
+		next_y = (cell.y + (step.y > 0) - g0.y) / d.y;
+		delta_y = step.y / d.y;
+	}
+
+	float t = t0;
+	b2Vec2 normal(0, 0);
+	for(;;) {
+		if(is(cell.y, cell.x, mask)) {
+			hit.hit = true;
+			hit.tile = cell;
+			hit.fraction = t;
+			hit.point = from + t * (to - from);
+			hit.normal = normal;
+			return true;
+		}
+
+		if(next_x < next_y) {
+			if(next_x > t1)
+				break;
+			t = next_x;
+			next_x += delta_x;
+			cell.x += step.x;
+			normal.Set(-step.x, 0);
+		} else {
+			if(next_y > t1)
+				break;
+			t = next_y;
+			next_y += delta_y;
+			cell.y += step.y;
+			// Grid rows grow downwards, world y grows upwards.
+			normal.Set(0, step.y);
+		}
+
+		if(cell.x < 0 || cell.x >= mDim.x || cell.y < 0 || cell.y >= mDim.y)
+			break;
+	}
+
+	return false;
+}
+
+void GridQuery::raycast(const Ray* rays, size_t count, uint32_t mask,
+		Hit* hits) const
+{
+	for(size_t i = 0; i < count; ++i)
+		raycast(rays[i].from, rays[i].to, mask, hits[i]);
+}
+
+bool GridQuery::line_of_sight(const b2Vec2& from, const b2Vec2& to) const
+{
+	Hit hit;
+	return !raycast(from, to, tile_mask(Blueprint::Wwall), hit);
+}
+
+bool GridQuery::overlaps(const b2AABB& box, uint32_t mask) const
+{
+	// World y is flipped in the grid, so upper and lower swap.
+	const b2Vec2 lo = to_grid(b2Vec2(box.lowerBound.x, box.upperBound.y));
+	const b2Vec2 hi = to_grid(b2Vec2(box.upperBound.x, box.lowerBound.y));
+
+	// Touching a tile boundary is not overlapping.
+	const int c0 = std::max<int>(0, std::floor(lo.x));
+	const int c1 = std::min<int>(mDim.x, std::ceil(hi.x));
+	const int r0 = std::max<int>(0, std::floor(lo.y));
+	const int r1 = std::min<int>(mDim.y, std::ceil(hi.y));
+
+	for(int r = r0; r < r1; ++r)
+		for(int c = c0; c < c1; ++c)
+			if(is(r, c, mask))
+				return true;
+
+	return false;
+}
+
+void GridQuery::overlaps(const b2AABB* boxes, size_t count, uint32_t mask,
+		bool* results) const
+{
+	for(size_t i = 0; i < count; ++i)
+		results[i] = overlaps(boxes[i], mask);
+}
+
+GridQuery::Sweep GridQuery::sweep(const b2AABB& box, const b2Vec2& delta,
+		uint32_t mask) const
+{
+	// In the grid, as in overlaps()
+	b2Vec2 lo = to_grid(b2Vec2(box.lowerBound.x, box.upperBound.y));
+	b2Vec2 hi = to_grid(b2Vec2(box.upperBound.x, box.lowerBound.y));
+	b2Vec2 d(delta.x, -delta.y);
+
+	// Tiles in columns [c0, c1) and rows [r0, r1), or outside.
+	auto blocked = [&](int c0, int c1, int r0, int r1) {
+		if(c0 < 0 || r0 < 0 || c1 > mDim.x || r1 > mDim.y)
+			return true;
+		for(int r = r0; r < r1; ++r)
+			for(int c = c0; c < c1; ++c)
+				if(is(r, c, mask))
+					return true;
+		return false;
+	};
+
+	Sweep result;
+	result.stopped_x = false;
+	if(d.x != 0) {
+		const int r0 = std::floor(lo.y + SKIN);
+		const int r1 = std::ceil(hi.y - SKIN);
+		if(d.x > 0) {
+			for(int c = std::ceil(hi.x - SKIN); c < hi.x + d.x; ++c) {
+				if(blocked(c, c + 1, r0, r1)) {
+					d.x = c - hi.x;
+					result.stopped_x = true;
+					break;
+				}
+			}
+		} else {
+			for(int c = std::floor(lo.x + SKIN) - 1; c + 1 > lo.x + d.x; --c) {
+				if(blocked(c, c + 1, r0, r1)) {
+					d.x = c + 1 - lo.x;
+					result.stopped_x = true;
+					break;
+				}
+			}
+		}
+		lo.x += d.x;
+		hi.x += d.x;
+	}
+
+	result.stopped_y = false;
+	if(d.y != 0) {
+		const int c0 = std::floor(lo.x + SKIN);
+		const int c1 = std::ceil(hi.x - SKIN);
+		if(d.y > 0) {
+			for(int r = std::ceil(hi.y - SKIN); r < hi.y + d.y; ++r) {
+				if(blocked(c0, c1, r, r + 1)) {
+					d.y = r - hi.y;
+					result.stopped_y = true;
+					break;
+				}
+			}
+		} else {
+			for(int r = std::floor(lo.y + SKIN) - 1; r + 1 > lo.y + d.y; --r) {
+				if(blocked(c0, c1, r, r + 1)) {
+					d.y = r + 1 - lo.y;
+					result.stopped_y = true;
+					break;
+				}
+			}
+		}
+	}
+
+	result.delta = b2Vec2(d.x, -d.y);
+	return result;
+}
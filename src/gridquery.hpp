@@ -0,0 +1,98 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+
+// Ray casts and overlap tests straight on the tile map, in world
+// coordinates, for line of sight, ground probes and such, without
+// going through the Box2D chain loops.
+//
+// Which tiles stop a query is given as a mask of Blueprint::Tiles
+// bits, see tile_mask().
+class GridQuery
+{
+public:
+	struct Ray {
+		b2Vec2 from;
+		b2Vec2 to;
+	};
+
+	struct Sweep {
+		// Part of the move made, in world coordinates.
+		b2Vec2 delta;
+		// Whether a tile stopped the move along x, and along y.
+		bool stopped_x;
+		bool stopped_y;
+	};
+
+	struct Hit {
+		// Tile hit, in map coordinates.
+		IVec2 tile;
+		// Where the ray entered the tile, in world coordinates.
+		b2Vec2 point;
+		// Normal of the face entered, zero if the ray started
+		// (or entered the map) inside the tile.
+		b2Vec2 normal;
+		// Fraction of the ray until point.
+		float fraction;
+		bool hit;
+	};
+
+	// origin is the world position of the center of tile (0, 0);
+	// only the first dim.y rows and dim.x columns of map are used.
+	GridQuery(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+			const b2Vec2& origin):
+		mMap(map), mDim(dim), mOrigin(origin)
+	{}
+
+	static uint32_t tile_mask(unsigned tile)
+	{
+		return 1u << tile;
+	}
+
+	// First tile of a type in mask along the ray, walked tile by tile
+	// (Amanatides & Woo). Returns hit.hit.
+	bool raycast(const b2Vec2& from, const b2Vec2& to, uint32_t mask,
+		Hit& hit) const;
+
+	// Casts count rays, filling count hits.
+	void raycast(const Ray* rays, size_t count, uint32_t mask,
+		Hit* hits) const;
+
+	// No wall between two points.
+	bool line_of_sight(const b2Vec2& from, const b2Vec2& to) const;
+
+	// Whether the box touches any tile of a type in mask.
+	bool overlaps(const b2AABB& box, uint32_t mask) const;
+
+	// Tests count boxes, filling count results.
+	void overlaps(const b2AABB* boxes, size_t count, uint32_t mask,
+		bool* results) const;
+
+	// Move the box by delta, along x then along y, until it touches a
+	// tile of a type in mask. Unlike rays, boxes are stopped by the
+	// edges of the map. A box overlapping tiles slightly, by rounding,
+	// can still move along them.
+	Sweep sweep(const b2AABB& box, const b2Vec2& delta, uint32_t mask) const;
+
+private:
+	b2Vec2 to_grid(const b2Vec2& world) const
+	{
+		// In grid space, tile (c, r) spans [c, c+1) x [r, r+1).
+		return b2Vec2(world.x - mOrigin.x + 0.5f,
+			mOrigin.y - world.y + 0.5f);
+	}
+
+	bool is(int row, int col, uint32_t mask) const
+	{
+		return (mask >> mMap[row][col]) & 1u;
+	}
+
+	const HeapMatrix<uint8_t>& mMap;
+	IVec2 mDim;
+	b2Vec2 mOrigin;
+};
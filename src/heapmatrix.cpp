@@ -0,0 +1,52 @@
+#include "heapmatrix.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+#ifdef __SSE2__
+	// 0xff in the bytes of v whose bit is set in mask.
+	__m128i in_mask(__m128i v, uint32_t mask)
+	{
+		__m128i in = _mm_setzero_si128();
+		for(; mask; mask &= mask - 1)
+			in = _mm_or_si128(in, _mm_cmpeq_epi8(v,
+				_mm_set1_epi8(char(__builtin_ctz(mask)))));
+		return in;
+	}
+#endif
+}
+
+size_t rect_kernels::count_if(const uint8_t* first, size_t n,
+		const ValueMask& pred)
+{
+	size_t count = 0, i = 0;
+#ifdef __SSE2__
+	for(; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(first + i));
+		count += __builtin_popcount(_mm_movemask_epi8(in_mask(v, pred.mask)));
+	}
+#endif
+	for(; i < n; ++i)
+		count += pred(first[i]);
+	return count;
+}
+
+void rect_kernels::replace_if(uint8_t* first, size_t n, const ValueMask& pred,
+		const uint8_t& value)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i with = _mm_set1_epi8(char(value));
+	for(; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(first + i));
+		const __m128i in = in_mask(v, pred.mask);
+		_mm_storeu_si128((__m128i*)(first + i),
+			_mm_or_si128(_mm_and_si128(in, with), _mm_andnot_si128(in, v)));
+	}
+#endif
+	for(; i < n; ++i)
+		if(pred(first[i]))
+			first[i] = value;
+}
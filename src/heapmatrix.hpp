@@ -2,8 +2,49 @@
 
 #include <vector>
 #include <utility>
-#include <iostream>
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <typeinfo>
+#include "memstats.hpp"
+
+// Predicate of the bulk operations below, true for the values whose bit
+// is set in mask, such as a set of tile types. Byte and packed tiles
+// test it 16 at a time with SSE2.
+struct ValueMask
+{
+	explicit ValueMask(uint32_t m):
+		mask(m)
+	{}
+
+	template<class T>
+	bool operator()(const T& value) const
+	{
+		return value < 32 && (mask >> value) & 1;
+	}
+
+	uint32_t mask;
+};
+
+// Runs of n elements, with vector kernels for bytes.
+namespace rect_kernels {
+	template<class T, class Pred>
+	size_t count_if(const T* first, size_t n, const Pred& pred)
+	{
+		return std::count_if(first, first + n, pred);
+	}
+
+	template<class T, class Pred>
+	void replace_if(T* first, size_t n, const Pred& pred, const T& value)
+	{
+		std::replace_if(first, first + n, pred, value);
+	}
+
+	size_t count_if(const uint8_t* first, size_t n, const ValueMask& pred);
+	void replace_if(uint8_t* first, size_t n, const ValueMask& pred,
+		const uint8_t& value);
+}
 
 template<class T>
 class HeapMatrix
@@ -114,27 +155,73 @@ public:
 
 	typedef const Row<ConstIterator, ConstReference> ConstRow;
 
-	HeapMatrix() = default;
-	HeapMatrix(const HeapMatrix&) = default;
+	HeapMatrix():
+		mRows(0), mCols(0)
+	{
+		stats().hold(1, 0);
+	}
+
+	HeapMatrix(const HeapMatrix& other):
+		mRows(other.mRows), mCols(other.mCols),
+		mVec(other.mVec)
+	{
+		++stats().copies;
+		stats().hold(1, 0);
+		account(0);
+	}
 
 	HeapMatrix(size_t rows, size_t cols, const T& value = T()):
 		mRows(rows), mCols(cols),
 		mVec(rows*cols, value)
-	{}
+	{
+		stats().hold(1, 0);
+		account(0);
+	}
 
 	HeapMatrix(HeapMatrix &&other):
 		mRows(other.mRows), mCols(other.mCols),
 		mVec(std::move(other.mVec))
 	{
-		if(DEBUG)
-			std::cout << "HeapMatrix moved!" << std::endl;
+		++stats().moves;
+		stats().hold(1, 0);
+	}
+
+	~HeapMatrix()
+	{
+		stats().hold(-1, -int64_t(bytes()));
+	}
+
+	HeapMatrix& operator=(const HeapMatrix& other)
+	{
+		if(this != &other) {
+			++stats().copies;
+			const size_t before = bytes();
+			mRows = other.mRows;
+			mCols = other.mCols;
+			mVec = other.mVec;
+			account(before);
+		}
+		return *this;
+	}
+
+	HeapMatrix& operator=(HeapMatrix&& other)
+	{
+		++stats().moves;
+		const int64_t before = bytes() + other.bytes();
+		mRows = other.mRows;
+		mCols = other.mCols;
+		mVec = std::move(other.mVec);
+		stats().hold(0, int64_t(bytes() + other.bytes()) - before);
+		return *this;
 	}
 
 	void resize(size_t rows, size_t cols, const T& value = T())
 	{
+		const size_t before = bytes();
 		mRows = rows;
 		mCols = cols;
 		mVec.resize(rows * cols, value);
+		account(before);
 	}
 
 	Row<> operator[](size_t row)
@@ -167,6 +254,51 @@ public:
 		return ConstRow(mVec.end(), mCols);
 	}
 
+	// Bulk operations on the rows [row, row + rows) and the columns
+	// [col, col + cols), going through the storage a row at a time
+	// instead of through a Row per element.
+
+	void fill_rect(size_t row, size_t col, size_t rows, size_t cols,
+		const T& value)
+	{
+		assert(row + rows <= mRows && col + cols <= mCols);
+		for(size_t r = row; r < row + rows; ++r)
+			std::fill_n(mVec.begin() + r * mCols + col, cols, value);
+	}
+
+	// Copy the rectangle of src at (src_row, src_col) here. The two
+	// must not overlap, if src is this matrix.
+	void blit_rect(size_t row, size_t col, const HeapMatrix& src,
+		size_t src_row, size_t src_col, size_t rows, size_t cols)
+	{
+		assert(row + rows <= mRows && col + cols <= mCols);
+		assert(src_row + rows <= src.mRows && src_col + cols <= src.mCols);
+		for(size_t r = 0; r < rows; ++r) {
+			auto from = src.mVec.begin() + (src_row + r) * src.mCols + src_col;
+			std::copy(from, from + cols, mVec.begin() + (row + r) * mCols + col);
+		}
+	}
+
+	template<class Pred>
+	void replace_if(size_t row, size_t col, size_t rows, size_t cols,
+		const Pred& pred, const T& value)
+	{
+		assert(row + rows <= mRows && col + cols <= mCols);
+		for(size_t r = row; r < row + rows && cols; ++r)
+			rect_kernels::replace_if(&mVec[r * mCols + col], cols, pred, value);
+	}
+
+	template<class Pred>
+	size_t count_if(size_t row, size_t col, size_t rows, size_t cols,
+		const Pred& pred) const
+	{
+		assert(row + rows <= mRows && col + cols <= mCols);
+		size_t count = 0;
+		for(size_t r = row; r < row + rows && cols; ++r)
+			count += rect_kernels::count_if(&mVec[r * mCols + col], cols, pred);
+		return count;
+	}
+
 	size_t numRows() const
 	{
 		return mRows;
@@ -177,7 +309,40 @@ public:
 		return mCols;
 	}
 
+	// Bytes allocated for the elements.
+	size_t bytes() const
+	{
+		return storage_bytes(mVec);
+	}
+
+	// Counters shared by all the matrices of this element type.
+	static memstats::Counter& stats()
+	{
+		static memstats::Counter& c = memstats::counter("HeapMatrix", typeid(T));
+		return c;
+	}
+
 private:
+	template<class V>
+	static size_t storage_bytes(const V& vec)
+	{
+		return vec.capacity() * sizeof(typename V::value_type);
+	}
+
+	static size_t storage_bytes(const std::vector<bool>& vec)
+	{
+		return vec.capacity() / 8;
+	}
+
+	// The storage took before bytes, count what changed since.
+	void account(size_t before)
+	{
+		const size_t after = bytes();
+		if(after > before)
+			++stats().allocations;
+		stats().hold(0, int64_t(after) - int64_t(before));
+	}
+
 	size_t mRows, mCols;
 	Storage mVec;
 };
@@ -0,0 +1,241 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <cassert>
+
+namespace {
+	// Queue of the calling thread, in the system it works for.
+	thread_local const JobSystem* this_system = nullptr;
+	thread_local unsigned this_queue = 0;
+
+	// Jobs run by jobs waiting for others count in the busy time of the
+	// outermost one.
+	thread_local int depth = 0;
+}
+
+JobSystem& JobSystem::get()
+{
+	static JobSystem system(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	return system;
+}
+
+JobSystem::JobSystem(unsigned workers):
+	mMainThread(std::this_thread::get_id()),
+	mStart(std::chrono::steady_clock::now()),
+	mReady(0), mMainReady(0), mIdle(0), mWaiting(0),
+	mStop(false)
+{
+	for(unsigned i = 0; i <= workers; ++i)
+		mQueues.emplace_back(new Queue);
+	for(unsigned i = 1; i <= workers; ++i)
+		mThreads.emplace_back(&JobSystem::worker, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+	for(auto& t: mThreads)
+		t.join();
+}
+
+JobSystem::Job JobSystem::add(std::function<void()> work,
+		const std::vector<Job>& after, Affinity affinity)
+{
+	Job job = std::make_shared<Task>();
+	job->work = std::move(work);
+	job->affinity = affinity;
+	job->pending = 1;
+	job->done = false;
+
+	for(const Job& a: after) {
+		std::lock_guard<std::mutex> lock(a->mutex);
+		if(!a->done) {
+			++job->pending;
+			a->next.push_back(job);
+		}
+	}
+	if(--job->pending == 0)
+		schedule(job);
+	return job;
+}
+
+void JobSystem::wait(const Job& job)
+{
+	const bool main = std::this_thread::get_id() == mMainThread;
+	assert(main || job->affinity != MAIN);
+
+	const unsigned index = current();
+	while(!job->done) {
+		if(run_one(index, main))
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		++mWaiting;
+		mWake.wait(lock, [&]{
+			return job->done || mReady > 0 || (main && mMainReady > 0);
+		});
+		--mWaiting;
+	}
+}
+
+void JobSystem::wait(const std::vector<Job>& jobs)
+{
+	for(const Job& job: jobs)
+		wait(job);
+}
+
+void JobSystem::run_main(std::chrono::steady_clock::time_point until)
+{
+	assert(std::this_thread::get_id() == mMainThread);
+	while(mMainReady > 0 && std::chrono::steady_clock::now() < until
+			&& run_one(0, true))
+		;
+}
+
+void JobSystem::report(std::ostream& out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	const double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - mStart).count();
+	out << "Jobs over " << std::fixed << std::setprecision(1) << seconds
+		<< " s, " << workers() << " workers:\n"
+		<< std::setw(12) << "" << std::setw(10) << "jobs"
+		<< std::setw(10) << "steals" << std::setw(10) << "busy ms"
+		<< std::setw(10) << "busy %" << '\n';
+	for(size_t i = 0; i < mQueues.size(); ++i) {
+		const Queue& q = *mQueues[i];
+		const double busy = q.busy_ns / 1e6;
+		out << std::left << std::setw(12)
+			<< (i ? "worker " + std::to_string(i) : std::string("main"))
+			<< std::right << std::setprecision(0)
+			<< std::setw(10) << q.run.load() << std::setw(10) << q.steals.load()
+			<< std::setw(10) << busy << std::setprecision(1)
+			<< std::setw(10) << (seconds > 0 ? busy / 10 / seconds : 0) << '\n';
+	}
+	out.flags(flags);
+	out.precision(precision);
+	out.flush();
+}
+
+void JobSystem::worker(unsigned index)
+{
+	this_system = this;
+	this_queue = index;
+	for(;;) {
+		if(run_one(index, false))
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		if(mStop && mReady == 0)
+			return;
+		++mIdle;
+		mWake.wait(lock, [&]{ return mStop || mReady > 0; });
+		--mIdle;
+	}
+}
+
+void JobSystem::schedule(const Job& job)
+{
+	if(job->affinity == MAIN) {
+		std::lock_guard<std::mutex> lock(mMainMutex);
+		mMainJobs.push_back(job);
+		++mMainReady;
+	} else {
+		Queue& q = *mQueues[current()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.jobs.push_back(job);
+		++mReady;
+	}
+
+	if(mIdle > 0 || mWaiting > 0) {
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		if(job->affinity == MAIN || mWaiting > 0)
+			mWake.notify_all();
+		else
+			mWake.notify_one();
+	}
+}
+
+bool JobSystem::run_one(unsigned index, bool main)
+{
+	Job job;
+	if(main && mMainReady > 0) {
+		std::lock_guard<std::mutex> lock(mMainMutex);
+		if(!mMainJobs.empty()) {
+			job = std::move(mMainJobs.front());
+			mMainJobs.pop_front();
+			--mMainReady;
+		}
+	}
+
+	// The newest of our own jobs...
+	if(!job && mReady > 0) {
+		Queue& q = *mQueues[index];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if(!q.jobs.empty()) {
+			job = std::move(q.jobs.back());
+			q.jobs.pop_back();
+			--mReady;
+		}
+	}
+
+	// ...or the oldest of somebody else's.
+	for(size_t i = 1; !job && mReady > 0 && i < mQueues.size(); ++i) {
+		Queue& q = *mQueues[(index + i) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if(!q.jobs.empty()) {
+			job = std::move(q.jobs.front());
+			q.jobs.pop_front();
+			--mReady;
+			++mQueues[index]->steals;
+		}
+	}
+
+	if(!job)
+		return false;
+	run(index, job);
+	return true;
+}
+
+void JobSystem::run(unsigned index, const Job& job)
+{
+	const auto start = std::chrono::steady_clock::now();
+	++depth;
+	job->work();
+	--depth;
+	// Let go of what the work captured.
+	job->work = nullptr;
+
+	Queue& q = *mQueues[index];
+	++q.run;
+	if(!depth)
+		q.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+	std::vector<Job> next;
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->done = true;
+		next.swap(job->next);
+	}
+	for(const Job& n: next)
+		if(--n->pending == 0)
+			schedule(n);
+
+	if(mWaiting > 0) {
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mWake.notify_all();
+	}
+}
+
+unsigned JobSystem::current() const
+{
+	return this_system == this ? this_queue : 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+// A pool of worker threads running jobs, shared by everything that
+// runs in parallel so that cores are not oversubscribed.
+//
+// Jobs may wait for other jobs to finish before they start, making a
+// task graph. Each worker has its own deque of ready jobs: it takes the
+// newest of its own, which are likely still in cache, and when it runs
+// out steals the oldest of another. Jobs using Ogre or Box2D, which are
+// not thread safe, are pinned to the main thread, which runs them while
+// it waits for jobs, or on run_main().
+class JobSystem
+{
+	struct Task;
+
+public:
+	typedef std::shared_ptr<Task> Job;
+
+	enum Affinity {
+		ANY,
+		MAIN
+	};
+
+	// The one used by the whole program, created by the main thread.
+	static JobSystem& get();
+
+	// Workers besides the main thread; the main thread also runs jobs
+	// while it waits.
+	explicit JobSystem(unsigned workers);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Run work once the jobs in after are finished.
+	Job add(std::function<void()> work, const std::vector<Job>& after = {},
+		Affinity affinity = ANY);
+
+	// Run jobs until the given ones are finished. Jobs pinned to the
+	// main thread must not be waited for from other threads.
+	void wait(const Job& job);
+	void wait(const std::vector<Job>& jobs);
+
+	// Run the jobs pinned to the main thread that are ready, from it,
+	// until the time given.
+	void run_main(std::chrono::steady_clock::time_point until =
+		std::chrono::steady_clock::time_point::max());
+
+	unsigned workers() const
+	{
+		return mQueues.size() - 1;
+	}
+
+	// Jobs, steals and busy time per thread since the start.
+	void report(std::ostream& out) const;
+
+private:
+	struct Task {
+		std::function<void()> work;
+		Affinity affinity;
+		// Jobs in after not finished yet, plus one until add() returns.
+		std::atomic<int> pending;
+		std::atomic<bool> done;
+		std::mutex mutex;
+		// Waiting for this one, under mutex.
+		std::vector<Job> next;
+	};
+
+	// Ready jobs of a thread, and what it did.
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+		std::atomic<uint64_t> run, steals, busy_ns;
+		Queue(): run(0), steals(0), busy_ns(0) {}
+	};
+
+	void worker(unsigned index);
+	void schedule(const Job& job);
+	// Run one ready job, if any, false otherwise.
+	bool run_one(unsigned index, bool main);
+	void run(unsigned index, const Job& job);
+	// Queue of the calling thread, 0 for the main thread.
+	unsigned current() const;
+
+	// Queue 0 belongs to the main thread, the others to the workers.
+	std::vector<std::unique_ptr<Queue> > mQueues;
+	std::deque<Job> mMainJobs;
+	std::mutex mMainMutex;
+
+	std::vector<std::thread> mThreads;
+	std::thread::id mMainThread;
+	std::chrono::steady_clock::time_point mStart;
+
+	// Ready jobs, and threads sleeping until there are: idle workers,
+	// and threads waiting for jobs, which also wake up when any job is
+	// finished.
+	std::atomic<int> mReady, mMainReady;
+	std::atomic<int> mIdle, mWaiting;
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+	bool mStop;
+};
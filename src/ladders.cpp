@@ -0,0 +1,148 @@
+#include "ladders.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include "blueprint.hpp"
+#include "memstats.hpp"
+
+void Ladders::build(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		b2Body* body)
+{
+	mDim = dim;
+	mBody = body;
+	mIds.resize(dim.y, dim.x, 0);
+
+	merge(map, IVec2(0, 0), dim);
+
+	if(DEBUG)
+		std::cout << "Ladder sensors count: " << mRects.size() << std::endl;
+}
+
+void Ladders::update(const HeapMatrix<uint8_t>& map,
+		const std::vector<IVec2>& tiles)
+{
+	// A changed tile can split the rectangle it was in, or let its
+	// neighbours' rectangles grow: take those apart, then merge
+	// again what they covered.
+	IVec2 from = mDim, to(0, 0);
+	auto cover = [&](const IVec2& pos, const IVec2& size) {
+		from.x = std::min(from.x, pos.x);
+		from.y = std::min(from.y, pos.y);
+		to.x = std::max(to.x, pos.x + size.x);
+		to.y = std::max(to.y, pos.y + size.y);
+	};
+
+	const IVec2 around[5] = {
+		IVec2(0, 0), IVec2(0, 1), IVec2(-1, 0), IVec2(0, -1), IVec2(1, 0)
+	};
+	for(const IVec2& t: tiles) {
+		cover(t, IVec2(1, 1));
+		for(const IVec2& delta: around) {
+			IVec2 n = t + delta;
+			int i = at_tile(n.y, n.x);
+			if(i >= 0) {
+				cover(mRects[i].pos, mRects[i].size);
+				remove_rect(i + 1);
+			}
+		}
+	}
+
+	if(from.x < to.x)
+		merge(map, from, to);
+}
+
+void Ladders::merge(const HeapMatrix<uint8_t>& map, const IVec2& from,
+		const IVec2& to)
+{
+	auto free_ladder = [&](int r, int c) {
+		return map[r][c] == Blueprint::Wladder && !mIds[r][c];
+	};
+
+	// Greedy merge: grow each rectangle right as far as the row
+	// goes, then down as long as whole rows of the same width fit.
+	// Ladders are mostly MAX_OBJ_COLS wide columns, so this ends up
+	// with about one rectangle per ladder.
+	for(int r = from.y; r < to.y; ++r) {
+		for(int c = from.x; c < to.x; ++c) {
+			if(!free_ladder(r, c))
+				continue;
+
+			IVec2 size(1, 1);
+			while(c + size.x < mDim.x && free_ladder(r, c + size.x))
+				++size.x;
+
+			for(bool full = true; full && r + size.y < mDim.y;) {
+				for(int i = c; i < c + size.x; ++i) {
+					if(!free_ladder(r + size.y, i)) {
+						full = false;
+						break;
+					}
+				}
+				if(full)
+					++size.y;
+			}
+
+			add_rect(IVec2(c, r), size);
+			c += size.x - 1;
+		}
+	}
+}
+
+void Ladders::add_rect(const IVec2& pos, const IVec2& size)
+{
+	uint16_t id;
+	if(mFreeIds.empty()) {
+		assert(mRects.size() < std::numeric_limits<uint16_t>::max());
+		mRects.push_back(Rect());
+		id = mRects.size();
+	} else {
+		id = mFreeIds.back();
+		mFreeIds.pop_back();
+	}
+
+	for(int r = pos.y; r < pos.y + size.y; ++r)
+		for(int c = pos.x; c < pos.x + size.x; ++c)
+			mIds[r][c] = id;
+
+	// Tile centers are at toCoord(), so the rectangle's
+	// center is halfway between its first and last tiles.
+	b2Vec2 center = Blueprint::toCoord(pos)
+		+ 0.5f * b2Vec2(size.x - 1, -(size.y - 1));
+
+	b2PolygonShape shape;
+	shape.SetAsBox(size.x * 0.5f, size.y * 0.5f, center, 0);
+
+	b2FixtureDef def;
+	def.shape = &shape;
+	def.isSensor = true;
+
+	Rect& rect = mRects[id - 1];
+	rect.pos = pos;
+	rect.size = size;
+	rect.fixture = mBody->CreateFixture(&def);
+	memstats::fixtures().hold(1, sizeof(b2Fixture));
+}
+
+void Ladders::remove_rect(uint16_t id)
+{
+	Rect& rect = mRects[id - 1];
+	for(int r = rect.pos.y; r < rect.pos.y + rect.size.y; ++r)
+		for(int c = rect.pos.x; c < rect.pos.x + rect.size.x; ++c)
+			mIds[r][c] = 0;
+
+	mBody->DestroyFixture(rect.fixture);
+	rect.fixture = nullptr;
+	memstats::fixtures().hold(-1, -int64_t(sizeof(b2Fixture)));
+	rect.size = IVec2(0, 0);
+	mFreeIds.push_back(id);
+}
+
+int Ladders::at(const b2Vec2& world) const
+{
+	b2Vec2 local = world - mBody->GetPosition();
+	return at_tile(int(std::floor(0.5f - local.y)),
+		int(std::floor(local.x + 0.5f)));
+}
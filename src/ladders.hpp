@@ -0,0 +1,75 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <vector>
+#include <cstdint>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+
+// Physical side of the Wladder tiles.
+//
+// Ladder tiles are merged into maximal rectangles, each one added as a
+// single sensor fixture, instead of one fixture per tile. A grid of
+// rectangle indices answers "is this point on a ladder" without going
+// through the broadphase.
+class Ladders
+{
+public:
+	// A rectangle of ladder tiles, in map tiles, with its fixture.
+	// Unused slots, left by update(), have no fixture.
+	struct Rect {
+		IVec2 pos;
+		IVec2 size;
+		b2Fixture* fixture;
+	};
+
+	Ladders() = default;
+
+	// Merge the Wladder tiles in the first dim.y rows and dim.x
+	// columns of map, adding the sensors to body.
+	void build(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		b2Body* body);
+
+	// Some tiles of map changed: re-merge the ladders around them,
+	// leaving the other rectangles and their fixtures alone.
+	void update(const HeapMatrix<uint8_t>& map,
+		const std::vector<IVec2>& tiles);
+
+	// Index in getRects() of the ladder at a tile, or -1.
+	int at_tile(int row, int col) const
+	{
+		if(row < 0 || col < 0 || row >= mDim.y || col >= mDim.x)
+			return -1;
+		return int(mIds[row][col]) - 1;
+	}
+
+	// Index in getRects() of the ladder at a point in world
+	// coordinates, or -1.
+	int at(const b2Vec2& world) const;
+
+	bool on_ladder(const b2Vec2& world) const
+	{
+		return at(world) >= 0;
+	}
+
+	const std::vector<Rect>& getRects() const
+	{
+		return mRects;
+	}
+
+private:
+	// Merge the free ladder tiles with corners in [from, to).
+	void merge(const HeapMatrix<uint8_t>& map, const IVec2& from,
+		const IVec2& to);
+	void add_rect(const IVec2& pos, const IVec2& size);
+	void remove_rect(uint16_t id);
+
+	IVec2 mDim;
+	b2Body* mBody;
+
+	// Rectangle index + 1 per tile, 0 where there is no ladder.
+	HeapMatrix<uint16_t> mIds;
+	std::vector<Rect> mRects;
+	std::vector<uint16_t> mFreeIds;
+};
@@ -0,0 +1,862 @@
+#include "level.hpp"
+#include "circuit.hpp"
+#include "memstats.hpp"
+#include "trace.hpp"
+#include "jobs.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+void create_line_material()
+{
+	// NOTE: The second parameter to the create method is the resource group the material will be added to.
+	// If the group you name does not exist (in your resources.cfg file) the library will assert() and your program will crash
+	Ogre::MaterialPtr myManualObjectMaterial = Ogre::MaterialManager::getSingleton().create("line","General"); 
+	myManualObjectMaterial->setReceiveShadows(false); 
+	myManualObjectMaterial->getTechnique(0)->setLightingEnabled(true); 
+	myManualObjectMaterial->getTechnique(0)->getPass(0)->setDiffuse(0,1,1,0); 
+	myManualObjectMaterial->getTechnique(0)->getPass(0)->setAmbient(0,1,1); 
+	myManualObjectMaterial->getTechnique(0)->getPass(0)->setSelfIllumination(0,0,1);
+}
+
+Ogre::SceneNode* draw_lines(Ogre::SceneManager *sm, Ogre::SceneNode* root, const b2Vec2* verts, int count)
+{
+	Ogre::ManualObject* myManualObject = sm->createManualObject(); 
+	Ogre::SceneNode* myManualObjectNode = root->createChildSceneNode(); 
+	 
+	myManualObject->begin("line", Ogre::RenderOperation::OT_LINE_STRIP);
+	for(int i = 0; i < count; ++i) {
+		myManualObject->position(verts[i].x, verts[i].y, 2);
+	}
+	myManualObject->position(verts[0].x, verts[0].y, 2);
+	myManualObject->end();
+	 
+	myManualObjectNode->attachObject(myManualObject);
+	memstats::ogre_objects().hold(1, 0);
+	memstats::ogre_nodes().hold(1, 0);
+	return myManualObjectNode;
+}
+
+// Destroy a scene node, its children and everything attached to them.
+void destroy_node(Ogre::SceneManager* sm, Ogre::SceneNode* node)
+{
+	while(node->numChildren())
+		destroy_node(sm, static_cast<Ogre::SceneNode*>(node->getChild(0)));
+	while(node->numAttachedObjects()) {
+		sm->destroyMovableObject(node->getAttachedObject(0));
+		memstats::ogre_objects().hold(-1, 0);
+	}
+	sm->destroySceneNode(node);
+	memstats::ogre_nodes().hold(-1, 0);
+}
+
+// Material merged blocks are drawn with, taking the vertex colours.
+const char* TILES_MATERIAL = "tiles";
+
+// Material of the plane behind the level, seen through empty tiles.
+const char* BACKGROUND_MATERIAL = "grey";
+
+// How a block is drawn: the tile mesh scaled along z, moved in depth,
+// in the diffuse colour of a material.
+struct TileLook {
+	const char* material;
+	float scale;
+	float depth;
+};
+
+TileLook tile_look(Blueprint::Tiles t)
+{
+	switch(t) {
+		case Blueprint::Wladder:
+			return TileLook{"blue", 1.0f/3.0f, -1};
+		case Blueprint::WliftTrack:
+			return TileLook{"red", 1.0f/3.0f, 0};
+		case Blueprint::WmoverTrack:
+			return TileLook{"yellow", 1.0f/3.0f, 1};
+		case Blueprint::Wwall:
+		case Blueprint::Wempty:
+			// Empty tiles have no block...
+			;
+	}
+	return TileLook{"darkgrey", 1, 0};
+}
+
+// Vertices and triangles of the first submesh of a mesh, the only one
+// of the tile mesh.
+struct Level::MeshGeometry {
+	// n floats per vertex each, empty when missing.
+	std::vector<float> positions, normals, uvs;
+	std::vector<uint32_t> indices;
+
+	explicit MeshGeometry(const Ogre::MeshPtr& mesh)
+	{
+		const Ogre::SubMesh* sub = mesh->getSubMesh(0);
+		const Ogre::VertexData* data = sub->useSharedVertices
+			? mesh->sharedVertexData : sub->vertexData;
+		positions = read(data, Ogre::VES_POSITION, 3);
+		normals = read(data, Ogre::VES_NORMAL, 3);
+		uvs = read(data, Ogre::VES_TEXTURE_COORDINATES, 2);
+
+		const Ogre::IndexData* index = sub->indexData;
+		auto& buffer = index->indexBuffer;
+		const char* start = static_cast<const char*>(
+			buffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY))
+			+ index->indexStart * buffer->getIndexSize();
+		if(buffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT) {
+			auto p = reinterpret_cast<const uint32_t*>(start);
+			indices.assign(p, p + index->indexCount);
+		} else {
+			auto p = reinterpret_cast<const uint16_t*>(start);
+			indices.assign(p, p + index->indexCount);
+		}
+		buffer->unlock();
+	}
+
+	size_t vertices() const
+	{
+		return positions.size() / 3;
+	}
+
+	static std::vector<float> read(const Ogre::VertexData* data,
+		Ogre::VertexElementSemantic semantic, int n)
+	{
+		std::vector<float> ret;
+		auto elem = data->vertexDeclaration->findElementBySemantic(semantic);
+		if(!elem)
+			return ret;
+		assert(Ogre::VertexElement::getTypeCount(elem->getType()) == n
+			&& Ogre::VertexElement::getBaseType(elem->getType()) == Ogre::VET_FLOAT1);
+
+		auto buffer = data->vertexBufferBinding->getBuffer(elem->getSource());
+		const size_t size = buffer->getVertexSize();
+		unsigned char* vertex = static_cast<unsigned char*>(
+			buffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY))
+			+ data->vertexStart * size;
+		for(size_t i = 0; i < data->vertexCount; ++i, vertex += size) {
+			float* value;
+			elem->baseVertexPointerToElement(vertex, &value);
+			ret.insert(ret.end(), value, value + n);
+		}
+		buffer->unlock();
+		return ret;
+	}
+};
+
+const uint16_t Level::DEFAULT_COLS, Level::DEFAULT_ROWS;
+const int Level::CHUNK_SIZE = 16;
+const int Level::LODS = 5;
+const float Level::LOD_DISTANCE = 48;
+
+Level::Level(Ogre::SceneManager* sm, b2World& physics,
+		uint16_t cols, uint16_t rows, uint64_t seed):
+	Level(sm, physics, std::unique_ptr<Blueprint>(
+		new Blueprint(cols, rows, seed)), seed)
+{}
+
+Level::Level(Ogre::SceneManager* sm, b2World& physics,
+		const LevelBundle& bundle, const std::string& dir):
+	Level(sm, physics, std::unique_ptr<Blueprint>(
+		new Blueprint(bundle.cols, bundle.rows, bundle.seed)),
+		bundle.seed, &bundle, dir)
+{}
+
+Level::Level(Ogre::SceneManager* sm, b2World& physics,
+		std::unique_ptr<Blueprint> blueprint, uint64_t seed,
+		const LevelBundle* baked, const std::string& dir):
+	mCols(blueprint->getMap().numCols()),
+	mRows(blueprint->getMap().numRows()),
+	mSeed(seed),
+	mBlueprint(std::move(blueprint)),
+	mPathfinder(*mBlueprint, IVec2(mCols, mRows)),
+	mPyramid(mBlueprint->getMap(), IVec2(mCols, mRows)),
+	mSceneMgr(sm),
+	mScheduler(nullptr),
+	mEye(0, 0, 0),
+	mActors(physics, sm),
+	mCharacters(mActors)
+{
+	assert(1 << (LODS - 1) == CHUNK_SIZE);
+
+	TRACE_SCOPE("Level::Level");
+
+	{
+		b2BodyDef def;
+		def.type = b2_staticBody;
+		mWorldBody = physics.CreateBody(&def);
+	}
+
+	if(baked && (baked->checksum != LevelBundle::tiles_checksum(
+			mBlueprint->getMap(), mCols, mRows)
+			|| baked->chunks.numRows() != size_t(mRows + CHUNK_SIZE - 1) / CHUNK_SIZE
+			|| baked->chunks.numCols() != size_t(mCols + CHUNK_SIZE - 1) / CHUNK_SIZE)) {
+		std::cerr << "Bundle " << dir << " is out of date, building the level\n";
+		baked = nullptr;
+	}
+
+	// Workers find the blocks and trace the collision loops, handed
+	// over to Ogre and Box2D on this thread, which builds the ladders
+	// and movers meanwhile.
+	std::vector<JobSystem::Job> jobs;
+	jobs.push_back(JobSystem::get().add([this]() {
+		mPyramid.build();
+	}));
+	build_background();
+	build_tiles(baked, dir, jobs);
+	build_collision(baked, jobs);
+
+	{
+		TRACE_SCOPE("Ladders::build");
+		mLadders.build(mBlueprint->getMap(), IVec2(mCols, mRows), mWorldBody);
+	}
+	{
+		TRACE_SCOPE("Movers::build");
+		mMovers.build(mBlueprint->getMap(), IVec2(mCols, mRows),
+			mBlueprint->getMaxObj(), physics, mWorldBody->GetPosition(),
+			mSceneMgr, mWalls);
+	}
+	JobSystem::get().wait(jobs);
+}
+
+void Level::update(float dt)
+{
+	TRACE_SCOPE("Level::update");
+
+	apply_changes();
+	mMovers.update(dt);
+}
+
+void Level::post_step()
+{
+	TRACE_SCOPE("Level::post_step");
+
+	mCharacters.resolve(getQuery());
+}
+
+void Level::sync()
+{
+	TRACE_SCOPE("Level::sync");
+
+	mMovers.sync_nodes();
+	mActors.sync_nodes();
+}
+
+void Level::save(Snapshot& snapshot) const
+{
+	TRACE_SCOPE("Level::save");
+
+	snapshot.clear();
+	snapshot.save_bodies(*mWorldBody->GetWorld());
+	mMovers.save(snapshot);
+	mCharacters.save(snapshot);
+}
+
+bool Level::restore(Snapshot& snapshot)
+{
+	TRACE_SCOPE("Level::restore");
+
+	snapshot.rewind();
+	if(!snapshot.load_bodies(*mWorldBody->GetWorld()))
+		return false;
+	mMovers.load(snapshot);
+	mCharacters.load(snapshot);
+	return true;
+}
+
+void Level::spawn_pills(size_t count, uint64_t seed)
+{
+	TRACE_SCOPE("Level::spawn_pills");
+
+	auto& map = mBlueprint->getMap();
+	Xoshiro256 rng(seed);
+	b2CircleShape pill;
+	pill.m_p.SetZero();
+	pill.m_radius = 0.4f;
+
+	// Levels are mostly open, give up on the ones that aren't
+	mActors.reserve(mActors.size() + count);
+	for(size_t tries = 0; count && tries < count * 16; ++tries) {
+		IVec2 tile(uniform_below(rng, mCols), uniform_below(rng, mRows));
+		if(map[tile.y][tile.x] != Blueprint::Wempty)
+			continue;
+		mActors.spawn(mWorldBody->GetPosition() + Blueprint::toCoord(tile),
+			pill, 1, "pill.mesh", "green");
+		--count;
+	}
+}
+
+void Level::spawn_characters(size_t count, uint64_t seed)
+{
+	TRACE_SCOPE("Level::spawn_characters");
+
+	auto& map = mBlueprint->getMap();
+	Xoshiro256 rng(seed);
+
+	// As big as a tile, walking either way at 1 to 3 tiles a second
+	mActors.reserve(mActors.size() + count);
+	for(size_t tries = 0; count && tries < count * 16; ++tries) {
+		IVec2 tile(uniform_below(rng, mCols), uniform_below(rng, mRows));
+		if(map[tile.y][tile.x] != Blueprint::Wempty)
+			continue;
+		const float speed = uniform_int(rng, 1, 3)
+			* (uniform_below(rng, 2) ? 1.0f : -1.0f);
+		mCharacters.spawn(mWorldBody->GetPosition() + Blueprint::toCoord(tile),
+			b2Vec2(0.5f, 0.5f), speed, "wall_tile.mesh", "yellow");
+		--count;
+	}
+}
+
+void Level::build_background()
+{
+	// First, we define a plane that will be the background of the level
+	auto &meshmngr = Ogre::MeshManager::getSingleton();
+	auto bg_wall_mesh = meshmngr.createPlane("bgWall", "General",
+			Ogre::Plane(Ogre::Vector3::UNIT_Z, 0),
+			mCols, mRows
+			// TODO: the rest of the parameters must be adjusted in order to use texture
+	);
+	auto bg_wall = mSceneMgr->createEntity(bg_wall_mesh);
+	bg_wall->setMaterialName(BACKGROUND_MATERIAL);
+	mSceneMgr->getRootSceneNode()->createChildSceneNode(Ogre::Vector3(0, 0, -1.5))->attachObject(bg_wall);
+	memstats::ogre_objects().hold(1, 0);
+	memstats::ogre_nodes().hold(1, 0);
+}
+
+void Level::build_tiles(const LevelBundle* baked, const std::string& dir,
+		std::vector<JobSystem::Job>& jobs)
+{
+	TRACE_SCOPE("Level::build_tiles");
+
+	// Create a scene node to displace to whole map to correct position 
+	mWalls = mSceneMgr->getRootSceneNode()->createChildSceneNode();
+	memstats::ogre_nodes().hold(1, 0);
+	mWalls->setPosition(Ogre::Vector3((mCols - 1) * -0.5, (mRows - 1) * 0.5, 0));
+
+	// Pre-load the tile mesh, with its buffers kept in memory too, as
+	// blocks are copies of it
+	mTileMesh = Ogre::MeshManager::getSingleton().load("wall_tile.mesh",
+		Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME,
+		Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY,
+		Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY, true, true);
+	mTileGeometry = std::make_shared<const MeshGeometry>(mTileMesh);
+	auto& materials = Ogre::MaterialManager::getSingleton();
+	for(int t = Blueprint::Wempty; t <= Blueprint::WmoverTrack; ++t) {
+		auto material = materials.getByName(t == Blueprint::Wempty
+			? BACKGROUND_MATERIAL
+			: tile_look(static_cast<Blueprint::Tiles>(t)).material);
+		mTileColours[t] = material->getTechnique(0)->getPass(0)->getDiffuse();
+	}
+
+	// Blocks are grouped in chunks, so that changing a tile
+	// only rebuilds its chunk
+	mChunks.resize((mRows + CHUNK_SIZE - 1) / CHUNK_SIZE,
+		(mCols + CHUNK_SIZE - 1) / CHUNK_SIZE, nullptr);
+	mRebuilding.resize(mChunks.numRows(), mChunks.numCols(), 0);
+	mChunkLods.resize(mChunks.numRows(), mChunks.numCols(), 0);
+	mCoarseChunks.resize(LODS - 1);
+	for(auto& coarse: mCoarseChunks)
+		coarse.resize(mChunks.numRows(), mChunks.numCols(), nullptr);
+	if(baked) {
+		auto& groups = Ogre::ResourceGroupManager::getSingleton();
+		groups.addResourceLocation(dir, "FileSystem", LevelBundle::GROUP);
+		groups.initialiseResourceGroup(LevelBundle::GROUP);
+	}
+	for(size_t i = 0; i < mChunks.numRows(); ++i) {
+		if(baked) {
+			for(size_t j = 0; j < mChunks.numCols(); ++j)
+				load_chunk(i, j, baked->chunks[i][j]);
+			continue;
+		}
+
+		// A row of chunks at a time
+		typedef std::vector<std::vector<IVec2> > Blocks;
+		auto blocks = std::make_shared<Blocks>(mChunks.numCols());
+		auto find = JobSystem::get().add([this, i, blocks]() {
+			for(size_t j = 0; j < blocks->size(); ++j)
+				chunk_blocks(i, j, (*blocks)[j]);
+		});
+		jobs.push_back(JobSystem::get().add([this, i, blocks]() {
+			for(size_t j = 0; j < blocks->size(); ++j)
+				build_chunk(i, j, (*blocks)[j]);
+		}, {find}, JobSystem::MAIN));
+	}
+
+	// Set correct position for world physics body
+	auto& walls_pos = mWalls->getPosition();
+	mWorldBody->SetTransform(b2Vec2(walls_pos.x, walls_pos.y), 0);
+}
+
+void Level::chunk_blocks(int row, int col, std::vector<IVec2>& blocks) const
+{
+	auto& map = mBlueprint->getMap();
+	const int end_row = std::min<int>(mRows, (row + 1) * CHUNK_SIZE);
+	const int end_col = std::min<int>(mCols, (col + 1) * CHUNK_SIZE);
+	for(int i = row * CHUNK_SIZE; i < end_row; ++i)
+		for(int j = col * CHUNK_SIZE; j < end_col; ++j)
+			if(map[i][j] != Blueprint::Wempty)
+				blocks.push_back(IVec2(j, i));
+}
+
+void Level::build_chunk(int row, int col, const std::vector<IVec2>& blocks)
+{
+	auto chunk = mWalls->createChildSceneNode();
+	mChunks[row][col] = chunk;
+	memstats::ogre_nodes().hold(1, 0);
+	if(blocks.empty())
+		return;
+
+	// Assemble the blocks, in a single batch
+	auto merged = mSceneMgr->createManualObject();
+	merge_blocks(merged, blocks, 0);
+	chunk->attachObject(merged);
+	memstats::ogre_objects().hold(1, 0);
+}
+
+void Level::rebuild_chunk(int row, int col)
+{
+	destroy_node(mSceneMgr, mChunks[row][col]);
+	for(auto& coarse: mCoarseChunks) {
+		if(coarse[row][col]) {
+			destroy_node(mSceneMgr, coarse[row][col]);
+			coarse[row][col] = nullptr;
+		}
+	}
+	std::vector<IVec2> blocks;
+	chunk_blocks(row, col, blocks);
+	build_chunk(row, col, blocks);
+
+	// The new chunk is in the scene, show what was shown instead
+	const int lod = mChunkLods[row][col];
+	mChunkLods[row][col] = 0;
+	set_chunk_lod(row, col, lod);
+}
+
+Ogre::SceneNode* Level::build_coarse_chunk(int row, int col, int lod)
+{
+	assert(lod > 0 && lod < LODS);
+
+	auto& cells = mPyramid.level(lod);
+	const IVec2 size = mPyramid.size(lod);
+	const int side = CHUNK_SIZE >> lod;
+
+	std::vector<IVec2> blocks;
+	for(int i = row * side; i < std::min((row + 1) * side, size.y); ++i)
+		for(int j = col * side; j < std::min((col + 1) * side, size.x); ++j)
+			if(cells[i][j] != Blueprint::Wempty)
+				blocks.push_back(IVec2(j, i));
+
+	auto chunk = mWalls->createChildSceneNode();
+	memstats::ogre_nodes().hold(1, 0);
+	if(!blocks.empty()) {
+		auto merged = mSceneMgr->createManualObject();
+		merge_blocks(merged, blocks, lod);
+		chunk->attachObject(merged);
+		memstats::ogre_objects().hold(1, 0);
+	}
+	return chunk;
+}
+
+void Level::set_chunk_lod(int row, int col, int lod)
+{
+	uint8_t& shown = mChunkLods[row][col];
+	if(shown == lod)
+		return;
+
+	mWalls->removeChild(shown ? mCoarseChunks[shown - 1][row][col]
+		: mChunks[row][col]);
+	shown = lod;
+	if(!lod) {
+		mWalls->addChild(mChunks[row][col]);
+	} else if(auto chunk = mCoarseChunks[lod - 1][row][col]) {
+		mWalls->addChild(chunk);
+	} else {
+		mCoarseChunks[lod - 1][row][col] = build_coarse_chunk(row, col, lod);
+	}
+}
+
+void Level::set_view(const Ogre::Vector3& eye)
+{
+	// Levels of detail only change over several tiles
+	const Ogre::Vector3 moved = eye - mEye;
+	if(moved.x * moved.x + moved.y * moved.y + moved.z * moved.z < 1)
+		return;
+	mEye = eye;
+
+	TRACE_SCOPE("Level::set_view");
+
+	// Relative to the centre of the first tile
+	const Ogre::Vector3 from = eye - mWalls->getPosition();
+	const float centre = (CHUNK_SIZE - 1) * 0.5f;
+	for(size_t i = 0; i < mChunks.numRows(); ++i) {
+		for(size_t j = 0; j < mChunks.numCols(); ++j) {
+			const float dx = j * CHUNK_SIZE + centre - from.x;
+			const float dy = -(i * CHUNK_SIZE + centre) - from.y;
+			const float dist2 = dx * dx + dy * dy + from.z * from.z;
+			int lod = 0;
+			for(float d = LOD_DISTANCE; lod < LODS - 1 && dist2 > d * d; d *= 2)
+				++lod;
+			set_chunk_lod(i, j, lod);
+		}
+	}
+}
+
+void Level::load_chunk(int row, int col, bool mesh)
+{
+	auto chunk = mWalls->createChildSceneNode();
+	mChunks[row][col] = chunk;
+	memstats::ogre_nodes().hold(1, 0);
+	if(!mesh)
+		return;
+
+	chunk->attachObject(mSceneMgr->createEntity(
+		Ogre::MeshManager::getSingleton().load(
+			LevelBundle::chunk_mesh(row, col), LevelBundle::GROUP)));
+	memstats::ogre_objects().hold(1, 0);
+}
+
+void Level::merge_blocks(Ogre::ManualObject* merged,
+		const std::vector<IVec2>& cells, int lod) const
+{
+	auto& types = mPyramid.level(lod);
+	const MeshGeometry& tile = *mTileGeometry;
+	const float scale = 1 << lod;
+	// From the centre of the first tile to the centre of the cell
+	const float offset = (scale - 1) * 0.5f;
+
+	merged->estimateVertexCount(cells.size() * tile.vertices());
+	merged->estimateIndexCount(cells.size() * tile.indices.size());
+	merged->begin(TILES_MATERIAL);
+	uint32_t base = 0;
+	for(const IVec2& c: cells) {
+		auto t = static_cast<Blueprint::Tiles>(types[c.y][c.x]);
+		const TileLook look = tile_look(t);
+		const Ogre::ColourValue& colour = mTileColours[t];
+		const float x = c.x * scale + offset;
+		const float y = -(c.y * scale + offset);
+		for(size_t v = 0; v < tile.vertices(); ++v) {
+			const float* p = &tile.positions[v * 3];
+			merged->position(p[0] * scale + x, p[1] * scale + y,
+				p[2] * look.scale + look.depth);
+			if(!tile.normals.empty()) {
+				// Scaling scales normals by the inverse
+				const float* n = &tile.normals[v * 3];
+				merged->normal(Ogre::Vector3(n[0] / scale, n[1] / scale,
+					n[2] / look.scale).normalisedCopy());
+			}
+			merged->colour(colour);
+			if(!tile.uvs.empty())
+				merged->textureCoord(tile.uvs[v * 2], tile.uvs[v * 2 + 1]);
+		}
+		for(uint32_t index: tile.indices)
+			merged->index(base + index);
+		base += tile.vertices();
+	}
+	merged->end();
+}
+
+void Level::export_chunk(int row, int col, const std::string& dir) const
+{
+	// The same blocks as build_chunk()
+	std::vector<IVec2> blocks;
+	chunk_blocks(row, col, blocks);
+	auto merged = mSceneMgr->createManualObject();
+	merge_blocks(merged, blocks, 0);
+
+	const std::string name = LevelBundle::chunk_mesh(row, col);
+	auto mesh = merged->convertToMesh(name);
+	Ogre::MeshSerializer().exportMesh(mesh.get(), dir + "/" + name);
+	Ogre::MeshManager::getSingleton().remove(name);
+	mSceneMgr->destroyManualObject(merged);
+}
+
+void Level::build_collision(const LevelBundle* baked,
+		std::vector<JobSystem::Job>& jobs)
+{
+	TRACE_SCOPE("Level::build_collision");
+
+	if(DEBUG)
+		create_line_material();
+	
+	// Build map collidable shape
+	mLoopOwners.resize(mRows, mCols * 4, 0);
+	if(baked) {
+		// Edges index mLoopOwners as a flat array
+		size_t vertex = 0, edge = 0;
+		for(size_t i = 0; i < baked->loopVertices.size(); ++i) {
+			mLoops.push_back(Loop());
+			const uint32_t id = mLoops.size();
+			create_loop(id, &baked->vertices[vertex], baked->loopVertices[i]);
+			vertex += baked->loopVertices[i];
+
+			Loop& loop = mLoops[id - 1];
+			for(int k = 0; k < baked->loopEdges[i]; ++k, ++edge) {
+				const int e = baked->edges[edge];
+				mLoopOwners[e / 4 / mCols][e % (mCols * 4)] = id;
+				loop.tiles.push_back(e / 4);
+			}
+		}
+		if(DEBUG)
+			std::cout << "Closed edges count: " << mLoops.size() << std::endl;
+		return;
+	}
+
+	// Loops are traced from every tile in turn, as the first one to
+	// reach an edge owns it.
+	auto trace = JobSystem::get().add([this]() {
+		TRACE_SCOPE("Level::trace_loops");
+		for(int i = 0; i < mRows; ++i)
+			for(int j = 0; j < mCols; ++j)
+				trace_loops(IVec2(j, i));
+	});
+	jobs.push_back(JobSystem::get().add([this]() {
+		create_traced();
+		if(DEBUG)
+			std::cout << "Closed edges count: " << mLoops.size() << std::endl;
+	}, {trace}, JobSystem::MAIN));
+}
+
+void Level::trace_loops(const IVec2& tile)
+{
+	auto& map = mBlueprint->getMap();
+	const IVec2 max(mCols, mRows);
+	if(map[tile.y][tile.x] == Blueprint::Wwall)
+		return;
+
+	// Walls on different sides of an open tile may be on different
+	// loops, e.g. in a corridor.
+	for(int s = 0; s < 4; ++s) {
+		auto side = static_cast<Circuit::Side>(s);
+		const IVec2 wall = tile - Circuit::FACING[s];
+		if(mLoopOwners[tile.y][tile.x * 4 + s]
+				|| !Circuit::is_wall(map, max, wall))
+			continue;
+
+		uint32_t id;
+		if(mFreeLoops.empty()) {
+			mLoops.push_back(Loop());
+			id = mLoops.size();
+		} else {
+			id = mFreeLoops.back();
+			mFreeLoops.pop_back();
+		}
+
+		Circuit c(map, mLoopOwners, id, max, wall, side);
+		mLoops[id - 1].tiles = c.getTiles();
+		mTraced.push_back(std::make_pair(id, c.getPath()));
+	}
+}
+
+void Level::create_traced()
+{
+	for(auto& t: mTraced)
+		create_loop(t.first, &t.second[0], t.second.size());
+	mTraced.clear();
+}
+
+void Level::create_loop(uint32_t id, const b2Vec2* path, int count)
+{
+	Loop& loop = mLoops[id - 1];
+	{
+		TRACE_SCOPE("Level::create_fixture");
+		b2ChainShape circuit_shape;
+		circuit_shape.CreateLoop(path, count);
+		b2FixtureDef def;
+		def.shape = &circuit_shape;
+		def.filter.categoryBits = Characters::WALLS;
+		loop.fixture = mWorldBody->CreateFixture(&def);
+	}
+	// The chain shape repeats the first vertex.
+	loop.vertices = count + 1;
+	memstats::fixtures().hold(1, sizeof(b2Fixture));
+	memstats::collision_vertices().hold(loop.vertices,
+		loop.vertices * sizeof(b2Vec2));
+	loop.lines = DEBUG ? draw_lines(mSceneMgr, mWalls, path, count) : nullptr;
+}
+
+bool Level::bake(const std::string& dir) const
+{
+	TRACE_SCOPE("Level::bake");
+
+	LevelBundle bundle;
+	bundle.cols = mCols;
+	bundle.rows = mRows;
+	bundle.seed = mSeed;
+	bundle.checksum = LevelBundle::tiles_checksum(mBlueprint->getMap(),
+		mCols, mRows);
+
+	// Edges of each loop, in map order; removed loops have none.
+	std::vector<std::vector<int32_t> > edges(mLoops.size());
+	for(int i = 0; i < mRows; ++i)
+		for(int j = 0; j < mCols * 4; ++j)
+			if(uint32_t id = mLoopOwners[i][j])
+				edges[id - 1].push_back(i * mCols * 4 + j);
+	for(size_t i = 0; i < mLoops.size(); ++i) {
+		if(!mLoops[i].fixture)
+			continue;
+		auto shape = static_cast<const b2ChainShape*>(
+			mLoops[i].fixture->GetShape());
+		// Without the repeated first vertex.
+		bundle.loopVertices.push_back(shape->m_count - 1);
+		bundle.vertices.insert(bundle.vertices.end(), shape->m_vertices,
+			shape->m_vertices + shape->m_count - 1);
+		bundle.loopEdges.push_back(edges[i].size());
+		bundle.edges.insert(bundle.edges.end(), edges[i].begin(),
+			edges[i].end());
+	}
+
+	auto& map = mBlueprint->getMap();
+	bundle.chunks.resize(mChunks.numRows(), mChunks.numCols(), 0);
+	for(int i = 0; i < mRows; ++i)
+		for(int j = 0; j < mCols; ++j)
+			if(map[i][j] != Blueprint::Wempty)
+				bundle.chunks[i / CHUNK_SIZE][j / CHUNK_SIZE] = 1;
+
+	// Creates dir, before the meshes are written there
+	if(!bundle.write(dir))
+		return false;
+
+	for(size_t i = 0; i < mChunks.numRows(); ++i)
+		for(size_t j = 0; j < mChunks.numCols(); ++j)
+			if(bundle.chunks[i][j])
+				export_chunk(i, j, dir);
+	return true;
+}
+
+void Level::remove_loop(uint32_t id, std::vector<int>& tiles)
+{
+	Loop& loop = mLoops[id - 1];
+	mWorldBody->DestroyFixture(loop.fixture);
+	loop.fixture = nullptr;
+	memstats::fixtures().hold(-1, -int64_t(sizeof(b2Fixture)));
+	memstats::collision_vertices().hold(-loop.vertices,
+		-int64_t(loop.vertices * sizeof(b2Vec2)));
+	loop.vertices = 0;
+	if(loop.lines)
+		destroy_node(mSceneMgr, loop.lines);
+	loop.lines = nullptr;
+
+	for(int t: loop.tiles) {
+		for(int s = 0; s < 4; ++s) {
+			auto& owner = mLoopOwners[t / mCols][t % mCols * 4 + s];
+			if(owner == id)
+				owner = 0;
+		}
+	}
+	tiles.insert(tiles.end(), loop.tiles.begin(), loop.tiles.end());
+	loop.tiles.clear();
+	mFreeLoops.push_back(id);
+}
+
+void Level::set_tile(const IVec2& tile, Blueprint::Tiles type)
+{
+	assert(tile.x >= 0 && tile.y >= 0 && tile.x < mCols && tile.y < mRows);
+
+	auto& map = mBlueprint->getMap();
+	if(map[tile.y][tile.x] == type)
+		return;
+	map[tile.y][tile.x] = type;
+	mChanged.push_back(tile);
+}
+
+void Level::add_tile_listener(const TileListener& listener)
+{
+	mListeners.push_back(listener);
+}
+
+FlowField& Level::add_flow_field(const std::vector<IVec2>& goals)
+{
+	TRACE_SCOPE("Level::add_flow_field");
+
+	mFlowFields.emplace_back(new FlowField(mBlueprint->getMap(),
+		IVec2(mCols, mRows)));
+	mFlowFields.back()->set_goals(goals);
+	return *mFlowFields.back();
+}
+
+void Level::remove_flow_field(const FlowField& field)
+{
+	auto it = std::find_if(mFlowFields.begin(), mFlowFields.end(),
+		[&field](const std::unique_ptr<FlowField>& f) {
+			return f.get() == &field;
+		});
+	assert(it != mFlowFields.end());
+	mFlowFields.erase(it);
+}
+
+void Level::apply_changes()
+{
+	if(mChanged.empty())
+		return;
+
+	TRACE_SCOPE("Level::apply_changes");
+
+	auto row_major = [](const IVec2& a, const IVec2& b) {
+		return a.y < b.y || (a.y == b.y && a.x < b.x);
+	};
+	std::sort(mChanged.begin(), mChanged.end(), row_major);
+	mChanged.erase(std::unique(mChanged.begin(), mChanged.end()),
+		mChanged.end());
+	mPyramid.update(mChanged);
+
+	// Rebuild the chunks holding changed tiles
+	std::vector<IVec2> chunks;
+	for(const IVec2& t: mChanged)
+		chunks.push_back(IVec2(t.x / CHUNK_SIZE, t.y / CHUNK_SIZE));
+	std::sort(chunks.begin(), chunks.end(), row_major);
+	chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+	// Spread over frames if there is a scheduler: chunks only show,
+	// unlike the collision loops.
+	for(const IVec2& c: chunks) {
+		if(!mScheduler) {
+			rebuild_chunk(c.y, c.x);
+		} else if(!mRebuilding[c.y][c.x]) {
+			mRebuilding[c.y][c.x] = 1;
+			mScheduler->add([this, c]() {
+				mRebuilding[c.y][c.x] = 0;
+				rebuild_chunk(c.y, c.x);
+			});
+		}
+	}
+
+	// A tile changing only moves the edges on its sides, and where
+	// loops turn around its neighbours: remove the loops going by
+	// those, then trace loops again from all the tiles they went by.
+	std::vector<int> seeds;
+	for(const IVec2& t: mChanged) {
+		for(int i = std::max(t.y - 1, 0); i <= std::min(t.y + 1, mRows - 1); ++i)
+			for(int j = std::max(t.x - 1, 0); j <= std::min(t.x + 1, mCols - 1); ++j)
+				seeds.push_back(i * mCols + j);
+	}
+	std::vector<uint32_t> removed;
+	for(int t: seeds)
+		for(int s = 0; s < 4; ++s)
+			if(uint32_t id = mLoopOwners[t / mCols][t % mCols * 4 + s])
+				removed.push_back(id);
+	std::sort(removed.begin(), removed.end());
+	removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+	for(uint32_t id: removed)
+		remove_loop(id, seeds);
+
+	std::sort(seeds.begin(), seeds.end());
+	seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+	for(int t: seeds)
+		trace_loops(IVec2(t % mCols, t / mCols));
+	create_traced();
+
+	// Navigation
+	mLadders.update(mBlueprint->getMap(), mChanged);
+	for(const IVec2& t: mChanged)
+		mPathfinder.invalidate_tile(t);
+	for(auto& field: mFlowFields)
+		field->recompute();
+
+	for(auto& listener: mListeners)
+		listener(mChanged);
+
+	if(DEBUG)
+		std::cout << "Changed tiles: " << mChanged.size()
+			<< ", chunks rebuilt: " << chunks.size()
+			<< ", loops retraced: " << removed.size() << std::endl;
+
+	mChanged.clear();
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <string>
+#include <memory>
+#include "blueprint.hpp"
+#include "bundle.hpp"
+#include "gridquery.hpp"
+#include "ladders.hpp"
+#include "movers.hpp"
+#include "actors.hpp"
+#include "characters.hpp"
+#include "pathfinder.hpp"
+#include "flowfield.hpp"
+#include "jobs.hpp"
+#include "scheduler.hpp"
+#include "tilepyramid.hpp"
+#include "snapshot.hpp"
+
+// A generated level, as seen by the renderer and the physics engine.
+class Level
+{
+public:
+	static const uint16_t DEFAULT_COLS = 130, DEFAULT_ROWS = 32;
+
+	Level(Ogre::SceneManager* sm, b2World& physics,
+		uint16_t cols=DEFAULT_COLS, uint16_t rows=DEFAULT_ROWS,
+		uint64_t seed=random_seed());
+
+	// Load a level baked in the bundle directory dir. If the tiles it
+	// was baked from can't be generated again, e.g. the generator
+	// changed since, the level is built as usual instead.
+	Level(Ogre::SceneManager* sm, b2World& physics,
+		const LevelBundle& bundle, const std::string& dir);
+
+	// A level generated beforehand from seed, e.g. in a job while the
+	// renderer starts up. Loaded from baked, if not null, as above.
+	Level(Ogre::SceneManager* sm, b2World& physics,
+		std::unique_ptr<Blueprint> blueprint, uint64_t seed,
+		const LevelBundle* baked = nullptr, const std::string& dir = "");
+
+	// Write the level to a bundle in the directory dir, for loading
+	// without building it again. Tiles changed since the level was
+	// generated make the bundle out of date.
+	bool bake(const std::string& dir) const;
+
+	// To be called before each physics step.
+	void update(float dt);
+
+	// Change a tile of the map. The scene, collision shapes, ladders
+	// and path finder catch up on the next update(), only around the
+	// tiles that changed, and flow fields are recomputed. Movers keep
+	// their tracks.
+	void set_tile(const IVec2& tile, Blueprint::Tiles type);
+
+	// Chunks changed are rebuilt by scheduler tasks, instead of on
+	// update(), if there is one.
+	void set_scheduler(FrameScheduler* scheduler)
+	{
+		mScheduler = scheduler;
+	}
+
+	// Chunks are drawn coarser the farther they are from the eye,
+	// with a block per cell of the tile pyramid level matching their
+	// distance, up to a block per chunk. To be called each frame.
+	void set_view(const Ogre::Vector3& eye);
+
+	// Called on update() with the tiles changed since the last one,
+	// e.g. to recompute flow fields.
+	typedef std::function<void(const std::vector<IVec2>&)> TileListener;
+	void add_tile_listener(const TileListener& listener);
+
+	// To be called right after each physics step.
+	void post_step();
+
+	// To be called once a frame, after the physics steps.
+	void sync();
+
+	// Capture the state of the physics, between steps, into snapshot.
+	void save(Snapshot& snapshot) const;
+
+	// Go back to the state in snapshot. Returns false, changing
+	// nothing, if bodies were added or removed since it was saved.
+	bool restore(Snapshot& snapshot);
+
+	// Drop count pills on open tiles picked at random.
+	void spawn_pills(size_t count, uint64_t seed=random_seed());
+
+	// Drop count characters on open tiles picked at random.
+	void spawn_characters(size_t count, uint64_t seed=random_seed());
+
+	Actors& getActors()
+	{
+		return mActors;
+	}
+
+	const Characters& getCharacters() const
+	{
+		return mCharacters;
+	}
+
+	const Ladders& getLadders() const
+	{
+		return mLadders;
+	}
+
+	Pathfinder& getPathfinder()
+	{
+		return mPathfinder;
+	}
+
+	// A flow field towards goals, e.g. for the agents chasing them,
+	// recomputed on update() when tiles changed. It is the level's,
+	// until remove_flow_field().
+	FlowField& add_flow_field(const std::vector<IVec2>& goals);
+	void remove_flow_field(const FlowField& field);
+
+	const TilePyramid& getPyramid() const
+	{
+		return mPyramid;
+	}
+
+	// Colour of each tile type as drawn, indexed by Blueprint::Tiles:
+	// from the material of its blocks, or of the background for empty
+	// tiles.
+	const Ogre::ColourValue* getTileColours() const
+	{
+		return mTileColours;
+	}
+
+	// Ray casts and overlap tests on the tile map.
+	GridQuery getQuery() const
+	{
+		return GridQuery(mBlueprint->getMap(), IVec2(mCols, mRows),
+			mWorldBody->GetPosition());
+	}
+
+private:
+	// A closed collision shape around walls.
+	struct Loop {
+		b2Fixture* fixture;
+		// Debug drawing, if any.
+		Ogre::SceneNode* lines;
+		// Indices of the open tiles it goes along.
+		std::vector<int> tiles;
+		// Held by the chain shape.
+		int vertices;
+	};
+
+	// Side of the render chunks, in tiles.
+	static const int CHUNK_SIZE;
+	// Levels of detail of the chunks, the last one a block per chunk,
+	// and distance from the eye up to which the first one is used,
+	// doubling for each next one.
+	static const int LODS;
+	static const float LOD_DISTANCE;
+
+	void build_background();
+	// Work left to jobs is added to jobs.
+	void build_tiles(const LevelBundle* baked, const std::string& dir,
+		std::vector<JobSystem::Job>& jobs);
+	// Tiles with a block in a chunk, added to blocks.
+	void chunk_blocks(int row, int col, std::vector<IVec2>& blocks) const;
+	void build_chunk(int row, int col, const std::vector<IVec2>& blocks);
+	void rebuild_chunk(int row, int col);
+	// From tile pyramid level lod, which must not be 0.
+	Ogre::SceneNode* build_coarse_chunk(int row, int col, int lod);
+	void set_chunk_lod(int row, int col, int lod);
+	// A chunk without blocks has no mesh.
+	void load_chunk(int row, int col, bool mesh);
+	void build_collision(const LevelBundle* baked,
+		std::vector<JobSystem::Job>& jobs);
+
+	// Copies of the tile mesh, one per cell of tile pyramid level lod,
+	// merged in a section of the tiles material, coloured by type.
+	struct MeshGeometry;
+	void merge_blocks(Ogre::ManualObject* merged,
+		const std::vector<IVec2>& cells, int lod) const;
+	void export_chunk(int row, int col, const std::string& dir) const;
+
+	// Create the fixture of loop id around a path.
+	void create_loop(uint32_t id, const b2Vec2* path, int count);
+	// Create the fixtures of the loops traced since the last call.
+	void create_traced();
+
+	// Add the loops along the walls around an open tile, unless there
+	// already are, without their fixtures.
+	void trace_loops(const IVec2& tile);
+	// Remove a loop, adding the tiles it went along to tiles.
+	void remove_loop(uint32_t id, std::vector<int>& tiles);
+
+	void apply_changes();
+
+	uint16_t mCols, mRows;
+	uint64_t mSeed;
+
+	// Generate map with XEvil algorithm.
+	std::unique_ptr<Blueprint> mBlueprint;
+	Pathfinder mPathfinder;
+	std::vector<std::unique_ptr<FlowField> > mFlowFields;
+	TilePyramid mPyramid;
+
+	Ogre::SceneManager* mSceneMgr;
+
+	// Scene node displacing the whole map to the correct position.
+	Ogre::SceneNode* mWalls;
+
+	// Per chunk of CHUNK_SIZE x CHUNK_SIZE tiles, the scene node
+	// holding its blocks.
+	HeapMatrix<Ogre::SceneNode*> mChunks;
+	// Whether a chunk has a rebuild queued in mScheduler.
+	HeapMatrix<uint8_t> mRebuilding;
+	FrameScheduler* mScheduler;
+	// Level of detail shown for each chunk, and the chunk nodes of the
+	// coarse ones, by level - 1, built when first shown. Only the nodes
+	// shown are in the scene.
+	HeapMatrix<uint8_t> mChunkLods;
+	std::vector<HeapMatrix<Ogre::SceneNode*> > mCoarseChunks;
+	// Where the eye was when levels of detail were last chosen.
+	Ogre::Vector3 mEye;
+	Ogre::MeshPtr mTileMesh;
+	std::shared_ptr<const MeshGeometry> mTileGeometry;
+	// By tile type, from the materials of the types.
+	Ogre::ColourValue mTileColours[Blueprint::WmoverTrack + 1];
+
+	// Static body holding the map collidable shape.
+	b2Body* mWorldBody;
+
+	// Loop id (index in mLoops + 1) of the edges around each open tile,
+	// by side of the wall, in columns col * 4 + side, 0 where none.
+	HeapMatrix<uint32_t> mLoopOwners;
+	std::vector<Loop> mLoops;
+	std::vector<uint32_t> mFreeLoops;
+	// Traced loops without a fixture yet, and their path.
+	std::vector<std::pair<uint32_t, std::vector<b2Vec2> > > mTraced;
+
+	std::vector<IVec2> mChanged;
+	std::vector<TileListener> mListeners;
+
+	Ladders mLadders;
+	Movers mMovers;
+	Actors mActors;
+	Characters mCharacters;
+};
@@ -2,300 +2,205 @@
 
 #include <unordered_set>
 #include <iostream>
-#include "blueprint.hpp"
-
-class Circuit
-{
-public:
-	Circuit(const HeapMatrix<uint8_t>& map, HeapMatrix<bool>& visited, const IVec2& max, IVec2 cur);
-	const std::vector<b2Vec2>& getPath() const
+#include <csignal>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "level.hpp"
+#include "bundle.hpp"
+#include "framestats.hpp"
+#include "memstats.hpp"
+#include "trace.hpp"
+#include "jobs.hpp"
+#include "scheduler.hpp"
+#include "minimap.hpp"
+#include "reachability.hpp"
+
+namespace {
+	const char* TRACE_FILE = "trace.json";
+
+	// Set on SIGUSR1, to write the trace on the next frame.
+	volatile std::sig_atomic_t trace_requested = 0;
+
+	void request_trace(int)
 	{
-		return mVertices;
+		trace_requested = 1;
 	}
-private:
-	enum Side {
-		DOWN,
-		LEFT,
-		UP,
-		RIGHT
-	};
-
-	static const b2Vec2 OFFSET[4];
-	static const IVec2 OPPOSITE[4];
-
-	bool is_wall(const IVec2& pos) const;
-	bool edge(Side s, IVec2 pos) const;
-	IVec2 next_from(Side s) const;
-
-	void trace(Side s);
-
-	const IVec2& mMax;
-	const HeapMatrix<uint8_t>& mMap;
-	HeapMatrix<bool>& mVisited;
-	std::vector<b2Vec2> mVertices;
-
-	IVec2 mCur;
-};
-
-const b2Vec2 Circuit::OFFSET[4] = {
-	b2Vec2(-0.5, -0.5),
-	b2Vec2(-0.5, 0.5),
-	b2Vec2(0.5, 0.5),
-	b2Vec2(0.5, -0.5)
-};
-
-const IVec2 Circuit::OPPOSITE[4] = {
-	IVec2(-1, 1),
-	IVec2(-1, -1),
-	IVec2(1, -1),
-	IVec2(1, 1)
-};
-
-Circuit::Circuit(const HeapMatrix<uint8_t>& map, HeapMatrix<bool>& visited, const IVec2& max, IVec2 cur):
-	mMax(max),
-	mMap(map),
-	mVisited(visited),
-	mCur(cur)
-{
-	assert(is_wall(cur));
-
-	mVisited[cur.y][cur.x] = true;
-	for(int s = 0; s < 4; ++s) {
-		Side side = static_cast<Side>(s);
-		if(edge(side, mCur)) {
-			trace(side);
-			break;
-		}
-	}
-}
-
-bool Circuit::is_wall(const IVec2& pos) const
-{
-	return static_cast<Blueprint::Tiles>(mMap[pos.y][pos.x]) == Blueprint::Wwall;
-}
 
-bool Circuit::edge(Side s, IVec2 pos) const
-{
-	// We work under assumption this position is a wall...
-	assert(is_wall(pos));
+	// Set on SIGUSR2, to print frame and memory statistics on the
+	// next frame.
+	volatile std::sig_atomic_t report_requested = 0;
 
-	// Displace pos to the relevant side:
-	switch(s)
+	void request_report(int)
 	{
-	case DOWN:
-		if(++pos.y >= mMax.y)
-			return false;
-		break;
-	case LEFT:
-		if(--pos.x < 0)
-			return false;
-		break;
-	case UP:
-		if(--pos.y < 0)
-			return false;
-		break;
-	case RIGHT:
-		if(++pos.x >= mMax.x)
-			return false;
-		break;
+		report_requested = 1;
 	}
 
-	// If new position is not a wall, and previous was,
-	// we found an edge!
-	return !is_wall(pos);
-}
+	// Pills and characters are dropped over the first frames, this many
+	// at a time.
+	const int PILLS_PER_TASK = 50;
 
-IVec2 Circuit::next_from(Side s) const
-{
-	IVec2 ret = mCur;
-	switch(s)
-	{
-	case DOWN:
-		--ret.x;
-		break;
-	case LEFT:
-		--ret.y;
-		break;
-	case UP:
-		++ret.x;
-		break;
-	case RIGHT:
-		++ret.y;
-		break;
-	}
-	return ret;
-}
-
-void Circuit::trace(Side s)
-{
-	for(;;) {
-		IVec2 next = next_from(s);
-		while(is_wall(next) && edge(s, next)) {
-			mCur = next;
-			mVisited[next.y][next.x] = true;
-			next = next_from(s);
-		}
+	// Where the Ogre plugins are, unless NSA_PLUGIN_DIR says otherwise.
+	const char* PLUGIN_DIR = "/usr/lib/x86_64-linux-gnu/OGRE-1.8.0";
 
-		b2Vec2 vertex = Blueprint::toCoord(mCur) + OFFSET[s];
-		if(!mVertices.empty()) {
-			b2Vec2 delta = mVertices[0] - vertex;
-			if(delta.x > -0.5 && delta.x < 0.5 && delta.y > -0.5 && delta.y < 0.5)
-				break;
+	// Generate count levels from consecutive seeds, printing those split
+	// in regions closed off from each other, and how many of the places
+	// can't be reached from the top left tile. Returns the number of
+	// levels split.
+	int check_levels(int count, uint16_t cols, uint16_t rows)
+	{
+		struct Result {
+			uint64_t seed;
+			Reachability::Report report;
+			double generate_ms;
+			double check_ms;
+		};
+		typedef std::chrono::steady_clock Clock;
+		auto ms = [](Clock::time_point since) {
+			return std::chrono::duration<double, std::milli>(
+				Clock::now() - since).count();
+		};
+
+		JobSystem& jobs = JobSystem::get();
+		const uint64_t first = random_seed();
+		std::vector<Result> results(count);
+		std::vector<JobSystem::Job> checks;
+		for(int i = 0; i < count; ++i) {
+			Result* result = &results[i];
+			result->seed = first + i;
+			checks.push_back(jobs.add([result, cols, rows, ms]() {
+				auto start = Clock::now();
+				Blueprint blueprint(cols, rows, result->seed);
+				result->generate_ms = ms(start);
+
+				start = Clock::now();
+				Reachability reach(blueprint.getMap(), IVec2(cols, rows));
+				result->report = reach.check(reach.first_passable());
+				result->check_ms = ms(start);
+			}));
 		}
-		mVertices.push_back(vertex);
-
-		Side maybe_next_side = static_cast<Side>((s+1) % 4);
-		if(edge(maybe_next_side, mCur)) {
-			// The edge follows the same tile around, clockwise...
-			s = maybe_next_side;
-		} else {
-			// The edge follows counter-clockwise, on another
-			// tile diagonally touching the current one...
-			mCur += OPPOSITE[s];
-			s = static_cast<Side>((s+3) % 4);
-
-			mVisited[mCur.y][mCur.x] = true;
-			assert(edge(s, mCur));
+		jobs.wait(checks);
+
+		int split = 0;
+		double generate_ms = 0, check_ms = 0;
+		double unreachable = 0, worst = 0;
+		uint64_t worst_seed = first;
+		for(const Result& r: results) {
+			generate_ms += r.generate_ms;
+			check_ms += r.check_ms;
+			const double part = r.report.places
+				? double(r.report.unreachable()) / r.report.places : 0;
+			unreachable += part;
+			if(part > worst) {
+				worst = part;
+				worst_seed = r.seed;
+			}
+			if(r.report.components > 1) {
+				++split;
+				std::cout << "Level " << r.seed << ": "
+					<< r.report.components << " components\n";
+			}
 		}
+		std::cout << split << " of " << count << " levels of " << cols
+			<< "x" << rows << " split; unreachable places "
+			<< 100 * unreachable / count << "% on average, "
+			<< 100 * worst << "% at most (level " << worst_seed << ")\n"
+			<< "Generating took " << generate_ms / count << " ms a level, "
+			<< "checking " << check_ms / count << " ms" << std::endl;
+		return split;
 	}
-}
-
-void create_line_material()
-{
-	// NOTE: The second parameter to the create method is the resource group the material will be added to.
-	// If the group you name does not exist (in your resources.cfg file) the library will assert() and your program will crash
-	Ogre::MaterialPtr myManualObjectMaterial = Ogre::MaterialManager::getSingleton().create("line","General"); 
-	myManualObjectMaterial->setReceiveShadows(false); 
-	myManualObjectMaterial->getTechnique(0)->setLightingEnabled(true); 
-	myManualObjectMaterial->getTechnique(0)->getPass(0)->setDiffuse(0,1,1,0); 
-	myManualObjectMaterial->getTechnique(0)->getPass(0)->setAmbient(0,1,1); 
-	myManualObjectMaterial->getTechnique(0)->getPass(0)->setSelfIllumination(0,0,1);
-}
-
-void draw_lines(Ogre::SceneManager *sm, Ogre::SceneNode* root, std::vector<b2Vec2> verts)
-{
-	Ogre::ManualObject* myManualObject = sm->createManualObject(); 
-	Ogre::SceneNode* myManualObjectNode = root->createChildSceneNode(); 
-	 
-	myManualObject->begin("line", Ogre::RenderOperation::OT_LINE_STRIP);
-	for(const auto& v: verts) {
-		myManualObject->position(v.x, v.y, 2);
-	}
-	myManualObject->position(verts[0].x, verts[0].y, 2);
-	myManualObject->end();
-	 
-	myManualObjectNode->attachObject(myManualObject);
-}
 
-void build_level(Ogre::SceneManager* sm, b2Body* world_body,
-		uint16_t cols=130, uint16_t rows=32)
-{
-	Ogre::SceneNode* root = sm->getRootSceneNode();
-
-	// First, we define a plane that will be the background of the level
-	auto &meshmngr = Ogre::MeshManager::getSingleton();
-	auto bg_wall_mesh = meshmngr.createPlane("bgWall", "General",
-			Ogre::Plane(Ogre::Vector3::UNIT_Z, 0),
-			cols, rows
-			// TODO: the rest of the parameters must be adjusted in order to use texture
-	);
-	auto bg_wall = sm->createEntity(bg_wall_mesh);
-	bg_wall->setMaterialName("grey");
-	root->createChildSceneNode(Ogre::Vector3(0, 0, -1.5))->attachObject(bg_wall);
-
-	// Drawing map.
-	// Generate map with XEvil algorithm and grab the matrix for usage.
-	HeapMatrix<uint8_t> map = std::move(Blueprint(cols, rows).getMap());
-
-	// Create a scene node to displace to whole map to correct position 
-	auto walls = root->createChildSceneNode();
-	walls->setPosition(Ogre::Vector3((cols - 1) * -0.5, (rows - 1) * 0.5, 0));
-
-	// Pre-load the tile mesh
-	auto wall_tile = meshmngr.load("wall_tile.mesh", Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME);
-	wall_tile->getSubMesh(0)->setMaterialName("darkgrey");
-
-	// Assemble the blocks
-	for(int i = 0; i < rows; ++i) {
-		for(int j = 0; j < cols; ++j) {
-			auto t = static_cast<Blueprint::Tiles>(map[i][j]);
-			if(t != Blueprint::Wempty) {
-				auto node = walls->createChildSceneNode(Ogre::Vector3(j, -i, 0));
-				// TODO: use different meshes for each tile...
-				auto block = sm->createEntity(wall_tile);
-				node->attachObject(block);
-
-				const char* mat_name = nullptr;
-				switch(t) {
-					case Blueprint::Wladder:
-						node->setScale(Ogre::Vector3(1, 1, 1.0/3.0));
-						node->translate(Ogre::Vector3(0, 0, -1));
-						mat_name = "blue";
-						break;
-					case Blueprint::WliftTrack:
-						mat_name = "red";
-						node->setScale(Ogre::Vector3(1, 1, 1.0/3.0));
-						break;
-					case Blueprint::WmoverTrack:
-						mat_name = "yellow";
-						node->setScale(Ogre::Vector3(1, 1, 1.0/3.0));
-						node->translate(Ogre::Vector3(0, 0, 1));
-						break;
-					case Blueprint::Wwall:
-						// Already set...
-					case Blueprint::Wempty:
-						// Can't happen...
-						;
-				}
-				if(mat_name)
-					block->setMaterialName(mat_name);
-			}	
+	// Time taken by each phase of the startup, printed as it ends, up
+	// to the first frame shown.
+	class StartupLog:
+		public Ogre::FrameListener
+	{
+	public:
+		StartupLog():
+			mStart(Clock::now()),
+			mLast(mStart),
+			mShown(false)
+		{}
+
+		void phase(const char* name)
+		{
+			const auto now = Clock::now();
+			std::cout << "Startup: " << name << ' '
+				<< std::chrono::duration<double, std::milli>(now - mLast).count()
+				<< " ms" << std::endl;
+			mLast = now;
 		}
-	}
 
-	// Set correct position for world physics body
-	auto& walls_pos = walls->getPosition();
-	world_body->SetTransform(b2Vec2(walls_pos.x, walls_pos.y), 0);
-
-	if(DEBUG)
-		create_line_material();
-	
-	// Build map collidable shape
-	HeapMatrix<bool> visited(rows, cols, false);
-	const IVec2 max(cols, rows);
-	int closed_edges_count = 0;
-	for(int i = 0; i < rows; ++i) {
-		for(int j = 0; j < cols; ++j) {
-			auto t = static_cast<Blueprint::Tiles>(map[i][j]);
-			if(t == Blueprint::Wwall && !visited[i][j]) {
-				Circuit c(map, visited, max, IVec2(j, i));
-				auto& path = c.getPath();
-				if(!path.empty()) {
-					b2ChainShape circuit_shape;
-					circuit_shape.CreateLoop(&path[0], path.size());
-					world_body->CreateFixture(&circuit_shape, 0);
-					++closed_edges_count;
-					if(DEBUG)
-						draw_lines(sm, walls, path);
-				}
+		bool frameEnded(const Ogre::FrameEvent&)
+		{
+			if(!mShown) {
+				mShown = true;
+				phase("first frame");
+				std::cout << "Startup: "
+					<< std::chrono::duration<double, std::milli>(mLast - mStart).count()
+					<< " ms to the first frame" << std::endl;
 			}
+			return true;
 		}
-	}
 
-	if(DEBUG)
-		std::cout << "Closed edges count: " << closed_edges_count << std::endl;
+	private:
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point mStart, mLast;
+		bool mShown;
+	};
 }
 
 class Updater:
 	public Ogre::FrameListener
 {
 public:
-	Updater(Ogre::SceneNode* cube, Ogre::Camera* cam):
-		x(-60), mCam(cam), mCube(cube)
+	Updater(Ogre::SceneNode* cube, Ogre::Camera* cam,
+			b2World& physics, Level& level, FrameStats& stats,
+			FrameScheduler& scheduler):
+		x(-60), mCam(cam), mCube(cube),
+		mPhysics(physics), mLevel(level), mStats(stats),
+		mScheduler(scheduler), mPhysicsTime(0)
 	{}
 
-	bool frameStarted(const Ogre::FrameEvent&)
+	bool frameStarted(const Ogre::FrameEvent& evt)
 	{
+		TRACE_SCOPE("Updater::frameStarted");
+
+		if(trace_requested) {
+			trace_requested = 0;
+			trace::write_json(TRACE_FILE);
+		}
+		if(report_requested) {
+			report_requested = 0;
+			mStats.report(std::cout);
+			memstats::report(std::cout);
+			JobSystem::get().report(std::cout);
+			mScheduler.report(std::cout);
+		}
+
+		mScheduler.run_frame();
+
+		// Physics runs at fixed time steps, so it doesn't
+		// depend on the frame rate.
+		const float STEP = 1.0f / 60.0f;
+		mPhysicsTime += evt.timeSinceLastFrame;
+		while(mPhysicsTime >= STEP) {
+			mLevel.update(STEP);
+			{
+				TRACE_SCOPE("b2World::Step");
+				auto start = std::chrono::steady_clock::now();
+				mPhysics.Step(STEP, 8, 3);
+				mStats.add_physics_time(std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - start).count());
+			}
+			mLevel.post_step();
+			mPhysicsTime -= STEP;
+		}
+		mLevel.sync();
+
 		/*auto angle = Ogre::Radian(Ogre::Math::UnitRandom() * 0.1);
 		auto rand_dir = Ogre::Vector3::UNIT_X.randomDeviant(angle, Ogre::Vector3::UNIT_Y);
 		auto rot = Ogre::Vector3::UNIT_X.getRotationTo(rand_dir);
@@ -310,6 +215,7 @@ public:
 		mCube->setPosition(Ogre::Vector3(x, 0, 0));
 		mCam->setPosition(Ogre::Vector3(x, y, 20));
 		//mCam->lookAt(Ogre::Vector3::ZERO);
+		mLevel.set_view(mCam->getPosition());
 
 		return true;
 	}
@@ -317,20 +223,80 @@ private:
 	float x;
 	Ogre::Camera* mCam;
 	Ogre::SceneNode* mCube;
+
+	b2World& mPhysics;
+	Level& mLevel;
+	FrameStats& mStats;
+	FrameScheduler& mScheduler;
+	float mPhysicsTime;
 };
 
-int main()
+int main(int argc, char* argv[])
 {
-	// Setup physics simulation Box2D
-	b2World physics(b2Vec2(0, -9.8));
+	StartupLog startup;
+
+	// --bake DIR writes the level generated to a bundle and quits,
+	// --check N generates N levels, reports which places can't be
+	// reached in them and quits,
+	// --load DIR starts with the level baked there, --budget MS is the
+	// time per frame for work queued for the main thread, --pills N the
+	// pills dropped in the level, which collide with the walls in Box2D,
+	// --characters N the characters, which collide with them on the tile
+	// map (see Characters; the trace shows what each costs). The
+	// environment variable NSA_PLUGIN_DIR is where the Ogre plugins are.
+	const char* bake_dir = nullptr;
+	const char* load_dir = nullptr;
+	float budget_ms = 4;
+	int pills = 200;
+	int characters = 20;
+	int check = 0;
+	for(int i = 1; i < argc; ++i) {
+		if(i + 1 < argc && !std::strcmp(argv[i], "--bake"))
+			bake_dir = argv[++i];
+		else if(i + 1 < argc && !std::strcmp(argv[i], "--load"))
+			load_dir = argv[++i];
+		else if(i + 1 < argc && !std::strcmp(argv[i], "--budget"))
+			budget_ms = std::atof(argv[++i]);
+		else if(i + 1 < argc && !std::strcmp(argv[i], "--pills"))
+			pills = std::max(std::atoi(argv[++i]), 0);
+		else if(i + 1 < argc && !std::strcmp(argv[i], "--characters"))
+			characters = std::max(std::atoi(argv[++i]), 0);
+		else if(i + 1 < argc && !std::strcmp(argv[i], "--check"))
+			check = std::max(std::atoi(argv[++i]), 1);
+		else {
+			std::cerr << "Usage: " << argv[0]
+				<< " [--bake DIR | --load DIR | --check N] [--budget MS] [--pills N]"
+				<< " [--characters N]\n";
+			return 1;
+		}
+	}
 
-	b2Body* world_body;
-	{
-		b2BodyDef def;
-		def.type = b2_staticBody;
-		world_body = physics.CreateBody(&def);
+	// Jobs pinned to the main thread run on the one creating the system
+	JobSystem& jobs = JobSystem::get();
+	if(check)
+		return check_levels(check, Level::DEFAULT_COLS, Level::DEFAULT_ROWS) ? 1 : 0;
+	FrameScheduler scheduler(budget_ms / 1000);
+
+	LevelBundle bundle;
+	if(load_dir && !bundle.read(load_dir)) {
+		std::cerr << "Can't read level bundle " << load_dir << "\n";
+		return 1;
 	}
 
+	// Generate the level while the renderer starts up. The job owns
+	// what it fills, in case we give up before it's done.
+	const uint64_t seed = load_dir ? bundle.seed : random_seed();
+	const uint16_t cols = load_dir ? bundle.cols : Level::DEFAULT_COLS;
+	const uint16_t rows = load_dir ? bundle.rows : Level::DEFAULT_ROWS;
+	auto blueprint = std::make_shared<std::unique_ptr<Blueprint> >();
+	auto generate = jobs.add([blueprint, cols, rows, seed]() {
+		blueprint->reset(new Blueprint(cols, rows, seed));
+	});
+	startup.phase("arguments");
+
+	// Setup physics simulation Box2D
+	b2World physics(b2Vec2(0, -9.8));
+
 	// Setup graphics engine Ogre
 	Ogre::Root renderer("", "", "renderer.log");
 
@@ -342,9 +308,11 @@ int main()
 		required_plugins.push_back("Octree Scene Manager");
 
 		// List of plugins to load
+		const char* env_dir = std::getenv("NSA_PLUGIN_DIR");
+		const Ogre::String plugin_dir = env_dir ? env_dir : PLUGIN_DIR;
 		Ogre::StringVector plugins_to_load;
-		plugins_to_load.push_back("/usr/lib/x86_64-linux-gnu/OGRE-1.8.0/RenderSystem_GL");
-		plugins_to_load.push_back("/usr/lib/x86_64-linux-gnu/OGRE-1.8.0/Plugin_OctreeSceneManager");
+		plugins_to_load.push_back(plugin_dir + "/RenderSystem_GL");
+		plugins_to_load.push_back(plugin_dir + "/Plugin_OctreeSceneManager");
 
 		for(auto& plugin_name: plugins_to_load) {
 			renderer.loadPlugin(plugin_name);
@@ -375,13 +343,21 @@ int main()
 	 
 		renderer.setRenderSystem(rs);
 	}
+	startup.phase("plugins");
+
+	std::unique_ptr<FrameStats> stats;
 
 	// Build scene
 	{
+		auto window = renderer.initialise(true, "No Such Arrocha");
+		startup.phase("window");
+
+		// Only the assets group: parses the material scripts, and
+		// declares the meshes, loaded when first used
 		renderer.addResourceLocation("./assets", "FileSystem", "General");
-		Ogre::ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
+		Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup("General");
+		startup.phase("resources");
 
-		auto window = renderer.initialise(true, "No Such Arrocha");
 		auto sceneManager = renderer.createSceneManager("OctreeSceneManager");
 		auto camera = sceneManager->createCamera("PlayerCam");
 
@@ -410,11 +386,70 @@ int main()
 		sun->setSpecularColour(Ogre::ColourValue::White);
 		sun->setDirection(Ogre::Vector3(-1, -5, -2));
 
-		build_level(sceneManager, world_body);
-		renderer.addFrameListener(new Updater(pill_node, camera));
+		// Frame statistics, also written to a file for each run
+		char csv_file[64];
+		const std::time_t now = std::time(nullptr);
+		std::strftime(csv_file, sizeof csv_file, "frames-%Y%m%d-%H%M%S.csv",
+			std::localtime(&now));
+		stats.reset(new FrameStats(window, sceneManager, 1.0f / 60.0f, csv_file));
+		renderer.addFrameListener(stats.get());
+		renderer.addFrameListener(&startup);
+		startup.phase("scene");
+
+		jobs.wait(generate);
+		startup.phase("waiting for generation");
+		auto level = new Level(sceneManager, physics, std::move(*blueprint),
+			seed, load_dir ? &bundle : nullptr, load_dir ? load_dir : "");
+		startup.phase("level");
+		if(bake_dir) {
+			if(!level->bake(bake_dir)) {
+				std::cerr << "Can't write level bundle " << bake_dir << "\n";
+				return 1;
+			}
+			std::cout << "Level baked to " << bake_dir << std::endl;
+			return 0;
+		}
+		level->set_scheduler(&scheduler);
+
+		// Not needed for the first frame
+		level->getActors().reserve(pills + characters);
+		for(int n = 0; n < pills; n += PILLS_PER_TASK) {
+			scheduler.add([level, n, pills]() {
+				level->spawn_pills(std::min(pills - n, PILLS_PER_TASK));
+			}, FrameScheduler::LOW);
+		}
+		for(int n = 0; n < characters; n += PILLS_PER_TASK) {
+			scheduler.add([level, n, characters]() {
+				level->spawn_characters(std::min(characters - n, PILLS_PER_TASK));
+			}, FrameScheduler::LOW);
+		}
+		const Ogre::Real aspect =
+			Ogre::Real(vp->getActualWidth()) / Ogre::Real(vp->getActualHeight());
+		scheduler.add([sceneManager, level, aspect]() {
+			auto minimap = new Minimap(sceneManager, level->getPyramid(),
+				level->getTileColours(), aspect);
+			level->add_tile_listener([minimap](const std::vector<IVec2>&) {
+				minimap->redraw();
+			});
+		}, FrameScheduler::LOW);
+
+		renderer.addFrameListener(new Updater(pill_node, camera, physics,
+			*level, *stats, scheduler));
 	}
 
+	if(DEBUG)
+		std::signal(SIGUSR1, request_trace);
+	std::signal(SIGUSR2, request_report);
+
 	renderer.startRendering();
 
+	stats->report(std::cout);
+	memstats::report(std::cout);
+	jobs.report(std::cout);
+	scheduler.report(std::cout);
+
+	if(DEBUG && trace::write_json(TRACE_FILE))
+		std::cout << "Trace written to " << TRACE_FILE << std::endl;
+
 	return 0;
 }
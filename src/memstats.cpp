@@ -0,0 +1,109 @@
+#include "memstats.hpp"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <iomanip>
+#include <cstdlib>
+#include <cxxabi.h>
+
+namespace memstats {
+
+namespace {
+	// Function statics, so that counters can be looked up while other
+	// statics are initialized.
+	std::mutex& registry_mutex()
+	{
+		static std::mutex m;
+		return m;
+	}
+
+	// Never destroyed: objects destroyed at exit still update their
+	// counters.
+	std::map<std::string, Counter*>& registry()
+	{
+		static auto r = new std::map<std::string, Counter*>;
+		return *r;
+	}
+}
+
+Counter::Counter(const std::string& name):
+	name(name),
+	allocations(0),
+	copies(0),
+	moves(0),
+	objects(0),
+	bytes(0),
+	peak(0)
+{}
+
+Counter& counter(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex());
+	Counter*& c = registry()[name];
+	if(!c)
+		c = new Counter(name);
+	return *c;
+}
+
+Counter& counter(const char* templ, const std::type_info& arg)
+{
+	int status;
+	std::unique_ptr<char, void(*)(void*)> demangled(
+		abi::__cxa_demangle(arg.name(), nullptr, nullptr, &status), std::free);
+	return counter(std::string(templ) + '<'
+		+ (status == 0 ? demangled.get() : arg.name()) + '>');
+}
+
+Counter& blueprint()
+{
+	static Counter& c = counter("Blueprint");
+	return c;
+}
+
+Counter& collision_vertices()
+{
+	static Counter& c = counter("Collision vertices");
+	return c;
+}
+
+Counter& fixtures()
+{
+	static Counter& c = counter("Box2D fixtures");
+	return c;
+}
+
+Counter& ogre_objects()
+{
+	static Counter& c = counter("Ogre objects");
+	return c;
+}
+
+Counter& ogre_nodes()
+{
+	static Counter& c = counter("Ogre scene nodes");
+	return c;
+}
+
+void report(std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex());
+
+	out << std::left << std::setw(40) << "Memory" << std::right
+		<< std::setw(10) << "objects" << std::setw(12) << "bytes"
+		<< std::setw(12) << "peak" << std::setw(10) << "allocs"
+		<< std::setw(8) << "copies" << std::setw(8) << "moves" << '\n';
+	for(const auto& entry: registry()) {
+		const Counter& c = *entry.second;
+		out << std::left << std::setw(40) << c.name << std::right
+			<< std::setw(10) << c.objects.load()
+			<< std::setw(12) << c.bytes.load()
+			<< std::setw(12) << c.peak.load()
+			<< std::setw(10) << c.allocations.load()
+			<< std::setw(8) << c.copies.load()
+			<< std::setw(8) << c.moves.load() << '\n';
+	}
+	out.flush();
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <ostream>
+#include <typeinfo>
+
+// Memory accounting: named counters of allocations, copies and moves,
+// and of objects and bytes held, per HeapMatrix instantiation and per
+// level subsystem. Counters live until the program ends and can be
+// updated from any thread.
+namespace memstats {
+	struct Counter
+	{
+		explicit Counter(const std::string& name);
+
+		Counter(const Counter&) = delete;
+		Counter& operator=(const Counter&) = delete;
+
+		// Objects and bytes going alive, negative when freed.
+		void hold(int64_t objs, int64_t size)
+		{
+			objects.fetch_add(objs, std::memory_order_relaxed);
+			const int64_t now =
+				bytes.fetch_add(size, std::memory_order_relaxed) + size;
+			int64_t p = peak.load(std::memory_order_relaxed);
+			while(now > p && !peak.compare_exchange_weak(p, now,
+					std::memory_order_relaxed))
+				;
+		}
+
+		const std::string name;
+
+		std::atomic<uint64_t> allocations;
+		// Deep copies, which are rarely intended, and moves.
+		std::atomic<uint64_t> copies;
+		std::atomic<uint64_t> moves;
+
+		std::atomic<int64_t> objects;
+		std::atomic<int64_t> bytes;
+		std::atomic<int64_t> peak;
+	};
+
+	// The counter with that name, created on first use.
+	Counter& counter(const std::string& name);
+
+	// Counter of a template instantiation, e.g. "HeapMatrix<unsigned char>".
+	Counter& counter(const char* templ, const std::type_info& arg);
+
+	// Level subsystems. Ogre owns the memory of its objects, they are
+	// only counted.
+	Counter& blueprint();
+	Counter& collision_vertices();
+	Counter& fixtures();
+	Counter& ogre_objects();
+	Counter& ogre_nodes();
+
+	// Every counter, by name.
+	void report(std::ostream& out);
+}
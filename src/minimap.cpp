@@ -0,0 +1,84 @@
+#include "minimap.hpp"
+#include "blueprint.hpp"
+#include "memstats.hpp"
+#include "trace.hpp"
+
+const char* Minimap::NAME = "minimap";
+
+namespace {
+	// Width of the minimap, in the -1 to 1 of screen coordinates.
+	const Ogre::Real WIDTH = 0.5;
+	const Ogre::Real MARGIN = 0.05;
+}
+
+Minimap::Minimap(Ogre::SceneManager* sm, const TilePyramid& pyramid,
+		const Ogre::ColourValue* colours, Ogre::Real aspect, int max_width):
+	mSceneMgr(sm),
+	mPyramid(pyramid),
+	mLevel(0)
+{
+	for(int t = Blueprint::Wempty; t <= Blueprint::WmoverTrack; ++t)
+		mColours[t] = colours[t].getAsARGB();
+
+	while(mLevel + 1 < mPyramid.levels() && mPyramid.size(mLevel).x > max_width)
+		++mLevel;
+	const IVec2 size = mPyramid.size(mLevel);
+
+	mTexture = Ogre::TextureManager::getSingleton().createManual(NAME,
+		"General", Ogre::TEX_TYPE_2D, size.x, size.y, 0,
+		Ogre::PF_X8R8G8B8, Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+
+	// Unlit, on top of everything, a texel a cell
+	auto material = Ogre::MaterialManager::getSingleton().create(NAME, "General");
+	auto pass = material->getTechnique(0)->getPass(0);
+	pass->setLightingEnabled(false);
+	pass->setDepthCheckEnabled(false);
+	pass->setDepthWriteEnabled(false);
+	pass->createTextureUnitState(NAME)->setTextureFiltering(Ogre::TFO_NONE);
+
+	// In the top right corner, keeping the proportions of the level
+	const Ogre::Real height = WIDTH * aspect * size.y / size.x;
+	mRect = new Ogre::Rectangle2D(true);
+	mRect->setCorners(1 - MARGIN - WIDTH, 1 - MARGIN,
+		1 - MARGIN, 1 - MARGIN - height);
+	mRect->setMaterial(NAME);
+	mRect->setRenderQueueGroup(Ogre::RENDER_QUEUE_OVERLAY);
+	Ogre::AxisAlignedBox always;
+	always.setInfinite();
+	mRect->setBoundingBox(always);
+
+	mNode = mSceneMgr->getRootSceneNode()->createChildSceneNode();
+	mNode->attachObject(mRect);
+	memstats::ogre_objects().hold(1, 0);
+	memstats::ogre_nodes().hold(1, 0);
+
+	redraw();
+}
+
+Minimap::~Minimap()
+{
+	mSceneMgr->destroySceneNode(mNode);
+	delete mRect;
+	memstats::ogre_objects().hold(-1, 0);
+	memstats::ogre_nodes().hold(-1, 0);
+	Ogre::MaterialManager::getSingleton().remove(NAME);
+	Ogre::TextureManager::getSingleton().remove(NAME);
+}
+
+void Minimap::redraw()
+{
+	TRACE_SCOPE("Minimap::redraw");
+
+	const HeapMatrix<uint8_t>& cells = mPyramid.level(mLevel);
+	const IVec2 size = mPyramid.size(mLevel);
+
+	Ogre::HardwarePixelBufferSharedPtr buffer = mTexture->getBuffer();
+	buffer->lock(Ogre::HardwareBuffer::HBL_DISCARD);
+	const Ogre::PixelBox& box = buffer->getCurrentLock();
+	for(int i = 0; i < size.y; ++i) {
+		auto texels = static_cast<uint32_t*>(box.data) + i * box.rowPitch;
+		for(int j = 0; j < size.x; ++j)
+			texels[j] = mColours[cells[i][j]];
+	}
+	buffer->unlock();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <cstdint>
+#include <OgreRectangle2D.h>
+#include "tilepyramid.hpp"
+#include "blueprint.hpp"
+
+// Overview of the whole level in a corner of the screen: a texel per
+// cell of the finest pyramid level narrow enough, on a single quad, so
+// it costs the same whatever the size of the level.
+class Minimap
+{
+public:
+	// At most max_width texels wide. The screen is aspect times as wide
+	// as it is high. Tiles are drawn in the colours given by tile type,
+	// as the level draws them (see Level::getTileColours()).
+	Minimap(Ogre::SceneManager* sm, const TilePyramid& pyramid,
+		const Ogre::ColourValue* colours, Ogre::Real aspect,
+		int max_width = 256);
+	~Minimap();
+
+	Minimap(const Minimap&) = delete;
+	Minimap& operator=(const Minimap&) = delete;
+
+	// Draw the pyramid again, after tiles changed.
+	void redraw();
+
+private:
+	static const char* NAME;
+
+	Ogre::SceneManager* mSceneMgr;
+	const TilePyramid& mPyramid;
+	// As ARGB texels, by tile type.
+	uint32_t mColours[Blueprint::WmoverTrack + 1];
+	int mLevel;
+
+	Ogre::TexturePtr mTexture;
+	Ogre::Rectangle2D* mRect;
+	Ogre::SceneNode* mNode;
+};
@@ -0,0 +1,160 @@
+#include "movers.hpp"
+
+#include <iostream>
+#include "blueprint.hpp"
+#include "memstats.hpp"
+
+namespace {
+	// In tiles per second.
+	const float MOVER_SPEED = 2.0f;
+	const float LIFT_SPEED = 1.5f;
+}
+
+void Movers::build(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		const IVec2& obj, b2World& physics, const b2Vec2& origin,
+		Ogre::SceneManager* sm, Ogre::SceneNode* parent)
+{
+	mOrigin = origin;
+	extract_tracks(map, dim, obj);
+
+	b2PolygonShape platform;
+	platform.SetAsBox(obj.x * 0.5f, 0.25f);
+
+	mBodies.reserve(size());
+	mNodes.reserve(size());
+	for(size_t i = 0; i < size(); ++i) {
+		b2BodyDef def;
+		def.type = b2_kinematicBody;
+		def.position = mOrigin + mStart[i];
+		b2Body* body = physics.CreateBody(&def);
+		body->CreateFixture(&platform, 0);
+		mBodies.push_back(body);
+
+		auto node = parent->createChildSceneNode(
+			Ogre::Vector3(mStart[i].x, mStart[i].y, 0));
+		node->setScale(Ogre::Vector3(obj.x, 0.5, 0.5));
+		auto block = sm->createEntity("wall_tile.mesh");
+		block->setMaterialName("grey");
+		node->attachObject(block);
+		mNodes.push_back(node);
+	}
+	memstats::fixtures().hold(size(), size() * sizeof(b2Fixture));
+	memstats::ogre_objects().hold(size(), 0);
+	memstats::ogre_nodes().hold(size(), 0);
+
+	if(DEBUG)
+		std::cout << "Movers count: " << size() << std::endl;
+}
+
+void Movers::extract_tracks(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		const IVec2& obj)
+{
+	// Platforms are centered on their tracks.
+	const float half = (obj.x - 1) * 0.5f;
+
+	// Horizontal movers: runs of WmoverTrack along a row, the
+	// platform's left side goes from the first tile of the run
+	// to obj.x tiles before its end.
+	for(int r = 0; r < dim.y; ++r) {
+		for(int c = 0; c < dim.x; ++c) {
+			if(map[r][c] != Blueprint::WmoverTrack)
+				continue;
+
+			int end = c;
+			while(end + 1 < dim.x && map[r][end + 1] == Blueprint::WmoverTrack)
+				++end;
+
+			int travel = end - c + 1 - obj.x;
+			if(travel >= 0) {
+				b2Vec2 start = Blueprint::toCoord(IVec2(c, r));
+				start.x += half;
+				add_track(start, b2Vec2(1, 0), travel);
+			}
+			c = end;
+		}
+	}
+
+	// Lifts: obj.x wide columns of WliftTrack. Only the leftmost
+	// column of each lift is followed, platform starts at the bottom.
+	for(int c = 0; c < dim.x; ++c) {
+		for(int r = 0; r < dim.y; ++r) {
+			if(map[r][c] != Blueprint::WliftTrack)
+				continue;
+
+			int end = r;
+			while(end + 1 < dim.y && map[end + 1][c] == Blueprint::WliftTrack)
+				++end;
+
+			if(c == 0 || map[r][c - 1] != Blueprint::WliftTrack) {
+				b2Vec2 start = Blueprint::toCoord(IVec2(c, end));
+				start.x += half;
+				add_track(start, b2Vec2(0, 1), end - r);
+			}
+			r = end;
+		}
+	}
+}
+
+void Movers::add_track(const b2Vec2& start, const b2Vec2& axis, float length)
+{
+	mStart.push_back(start);
+	mAxis.push_back(axis);
+	mLength.push_back(length);
+	mPos.push_back(0);
+
+	// Alternate the initial directions, so that neighbouring
+	// platforms don't move in lockstep.
+	float speed = axis.y ? LIFT_SPEED : MOVER_SPEED;
+	mSpeed.push_back(mSpeed.size() % 2 ? -speed : speed);
+}
+
+void Movers::update(float dt)
+{
+	if(dt <= 0)
+		return;
+
+	const float inv_dt = 1.0f / dt;
+	const size_t count = size();
+	for(size_t i = 0; i < count; ++i) {
+		float pos = mPos[i] + mSpeed[i] * dt;
+
+		// Bounce at track ends.
+		if(pos < 0) {
+			pos = -pos;
+			mSpeed[i] = -mSpeed[i];
+		} else if(pos > mLength[i]) {
+			pos = 2 * mLength[i] - pos;
+			mSpeed[i] = -mSpeed[i];
+		}
+		// Track shorter than a single step.
+		if(pos < 0 || pos > mLength[i])
+			pos = 0;
+		mPos[i] = pos;
+
+		// Kinematic bodies are integrated exactly by the step, so
+		// aiming from the actual body position can't drift.
+		b2Vec2 target = mOrigin + mStart[i] + pos * mAxis[i];
+		mBodies[i]->SetLinearVelocity(inv_dt * (target - mBodies[i]->GetPosition()));
+	}
+}
+
+void Movers::save(Snapshot& snapshot) const
+{
+	snapshot.write(mPos);
+	snapshot.write(mSpeed);
+}
+
+void Movers::load(Snapshot& snapshot)
+{
+	snapshot.read(mPos);
+	snapshot.read(mSpeed);
+}
+
+void Movers::sync_nodes()
+{
+	const size_t count = size();
+	for(size_t i = 0; i < count; ++i) {
+		b2Vec2 p = mStart[i] + mPos[i] * mAxis[i];
+		mNodes[i]->setPosition(p.x, p.y, 0);
+	}
+}
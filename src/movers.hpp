@@ -0,0 +1,61 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <vector>
+#include <cstdint>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+#include "snapshot.hpp"
+
+// Kinematic platforms riding the WmoverTrack and WliftTrack tiles
+// laid down by Blueprint.
+//
+// There is no mover object: the state of every mover lives in parallel
+// arrays, so the whole level is advanced in one pass per physics step
+// and written to the scene graph in another, without virtual calls.
+class Movers
+{
+public:
+	Movers() = default;
+
+	// Extract the tracks from the tile map and spawn one kinematic
+	// body and scene node for each of them. Tracks are searched in
+	// the first dim.y rows and dim.x columns of map; obj is the
+	// size of a mover platform, in tiles.
+	void build(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		const IVec2& obj, b2World& physics, const b2Vec2& origin,
+		Ogre::SceneManager* sm, Ogre::SceneNode* parent);
+
+	// Advance every mover along its track, and set the body velocities
+	// so the next physics step takes them there.
+	void update(float dt);
+
+	// Copy the mover positions into their scene nodes.
+	void sync_nodes();
+
+	// Progress along the tracks, the bodies are saved apart.
+	void save(Snapshot& snapshot) const;
+	void load(Snapshot& snapshot);
+
+	size_t size() const
+	{
+		return mPos.size();
+	}
+
+private:
+	void extract_tracks(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		const IVec2& obj);
+	void add_track(const b2Vec2& start, const b2Vec2& axis, float length);
+
+	// Per mover state, indexed alike:
+	std::vector<b2Vec2> mStart;	// track start, in map coordinates
+	std::vector<b2Vec2> mAxis;	// unit direction of the track
+	std::vector<float> mLength;	// track length
+	std::vector<float> mPos;	// distance travelled along the track
+	std::vector<float> mSpeed;	// signed speed along the axis
+	std::vector<b2Body*> mBodies;
+	std::vector<Ogre::SceneNode*> mNodes;
+
+	b2Vec2 mOrigin;
+};
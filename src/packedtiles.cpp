@@ -0,0 +1,276 @@
+#include "packedtiles.hpp"
+
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+PackedTiles::PackedTiles(const HeapMatrix<uint8_t>& map):
+	mCols(map.numCols()),
+	mBytes(map.numRows(), (map.numCols() + 1) / 2)
+{
+	for(size_t r = 0; r < map.numRows(); ++r)
+		pack(r, 0, mCols, &map[r][0]);
+}
+
+void PackedTiles::unpack(size_t row, size_t col, size_t n, uint8_t* out) const
+{
+	const uint8_t* in = &mBytes[row][0];
+	if(n && col & 1) {
+		*out++ = in[col / 2] >> 4;
+		++col;
+		--n;
+	}
+	in += col / 2;
+
+	size_t i = 0;
+#ifdef __SSE2__
+	// 16 bytes give 32 tiles: the low halves are the even ones, the
+	// high halves the odd ones, interleaved back in order.
+	const __m128i low = _mm_set1_epi8(MAX_VALUE);
+	for(; i + 32 <= n; i += 32) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(in + i / 2));
+		const __m128i even = _mm_and_si128(v, low);
+		const __m128i odd = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi8(even, odd));
+		_mm_storeu_si128((__m128i*)(out + i + 16), _mm_unpackhi_epi8(even, odd));
+	}
+#endif
+	for(; i < n; ++i)
+		out[i] = (in[i / 2] >> ((i & 1) * 4)) & MAX_VALUE;
+}
+
+void PackedTiles::pack(size_t row, size_t col, size_t n, const uint8_t* in)
+{
+	Row dst = (*this)[row];
+	if(n && col & 1) {
+		dst[col++] = *in++;
+		--n;
+	}
+	uint8_t* out = &mBytes[row][col / 2];
+
+	size_t i = 0;
+#ifdef __SSE2__
+	// In each 16 bit lane of tiles, the odd tile shifted down by 4
+	// lands in the high half of the low byte, then the lanes are
+	// narrowed to bytes.
+	const __m128i low = _mm_set1_epi8(MAX_VALUE);
+	const __m128i even = _mm_set1_epi16(MAX_VALUE);
+	for(; i + 32 <= n; i += 32) {
+		const __m128i a = _mm_and_si128(
+			_mm_loadu_si128((const __m128i*)(in + i)), low);
+		const __m128i b = _mm_and_si128(
+			_mm_loadu_si128((const __m128i*)(in + i + 16)), low);
+		const __m128i pa = _mm_or_si128(_mm_and_si128(a, even),
+			_mm_srli_epi16(a, 4));
+		const __m128i pb = _mm_or_si128(_mm_and_si128(b, even),
+			_mm_srli_epi16(b, 4));
+		_mm_storeu_si128((__m128i*)(out + i / 2), _mm_packus_epi16(pa, pb));
+	}
+#endif
+	for(; i + 2 <= n; i += 2) {
+		assert(in[i] <= MAX_VALUE && in[i + 1] <= MAX_VALUE);
+		out[i / 2] = in[i] | (in[i + 1] << 4);
+	}
+	if(i < n)
+		dst[col + i] = in[i];
+}
+
+void PackedTiles::match(size_t row, size_t col, size_t n, uint8_t value,
+		uint64_t* bits) const
+{
+	std::memset(bits, 0, (n + 63) / 64 * sizeof(uint64_t));
+	const uint8_t* in = &mBytes[row][0];
+
+	size_t i = 0;
+	if(n && col & 1) {
+		bits[0] = (in[col / 2] >> 4) == value;
+		i = 1;
+	}
+
+#ifdef __SSE2__
+	// Tiles are compared unpacked, 32 at a time, the bits of each
+	// group landing on one or two words.
+	const __m128i low = _mm_set1_epi8(MAX_VALUE);
+	const __m128i wanted = _mm_set1_epi8(value);
+	for(; i + 32 <= n; i += 32) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(in + (col + i) / 2));
+		const __m128i even = _mm_and_si128(v, low);
+		const __m128i odd = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+		const uint32_t first = _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_unpacklo_epi8(even, odd), wanted));
+		const uint32_t second = _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_unpackhi_epi8(even, odd), wanted));
+		const uint64_t m = first | (second << 16);
+		const size_t shift = i % 64;
+		bits[i / 64] |= m << shift;
+		if(shift > 32)
+			bits[i / 64 + 1] |= m >> (64 - shift);
+	}
+#endif
+	for(; i < n; ++i) {
+		const size_t c = col + i;
+		if(((in[c / 2] >> ((c & 1) * 4)) & MAX_VALUE) == value)
+			bits[i / 64] |= uint64_t(1) << (i % 64);
+	}
+}
+
+namespace {
+#ifdef __SSE2__
+	// 0xff in the bytes of v whose bit is set in mask.
+	__m128i in_mask(__m128i v, uint32_t mask)
+	{
+		__m128i in = _mm_setzero_si128();
+		for(mask &= 0xffff; mask; mask &= mask - 1)
+			in = _mm_or_si128(in, _mm_cmpeq_epi8(v,
+				_mm_set1_epi8(char(__builtin_ctz(mask)))));
+		return in;
+	}
+#endif
+}
+
+void PackedTiles::fill_rect(size_t row, size_t col, size_t rows, size_t cols,
+		uint8_t value)
+{
+	assert(row + rows <= numRows() && col + cols <= mCols);
+	if(!cols)
+		return;
+
+	// Whole bytes in the middle, a tile on either side
+	const size_t first = (col + 1) / 2, last = (col + cols) / 2;
+	for(size_t r = row; r < row + rows; ++r) {
+		Row tiles = (*this)[r];
+		if(col & 1)
+			tiles[col] = value;
+		if(last > first)
+			std::memset(&mBytes[r][first], fill(value), last - first);
+		if(!((col + cols - 1) & 1))
+			tiles[col + cols - 1] = value;
+	}
+}
+
+void PackedTiles::blit_rect(size_t row, size_t col, const PackedTiles& src,
+		size_t src_row, size_t src_col, size_t rows, size_t cols)
+{
+	assert(row + rows <= numRows() && col + cols <= mCols);
+	assert(src_row + rows <= src.numRows() && src_col + cols <= src.mCols);
+
+	// Copied as bytes when the tiles line up, unpacked and packed
+	// back otherwise
+	uint8_t tiles[256];
+	for(size_t r = 0; r < rows; ++r) {
+		if((col & 1) == (src_col & 1) && cols > 2) {
+			size_t c = 0;
+			if(col & 1) {
+				(*this)[row + r][col] = src[src_row + r][src_col];
+				c = 1;
+			}
+			const size_t bytes = (cols - c) / 2;
+			std::memcpy(&mBytes[row + r][(col + c) / 2],
+				&src.mBytes[src_row + r][(src_col + c) / 2], bytes);
+			c += bytes * 2;
+			if(c < cols)
+				(*this)[row + r][col + c] = src[src_row + r][src_col + c];
+			continue;
+		}
+		for(size_t c = 0; c < cols; c += sizeof tiles) {
+			const size_t n = std::min(cols - c, sizeof tiles);
+			src.unpack(src_row + r, src_col + c, n, tiles);
+			pack(row + r, col + c, n, tiles);
+		}
+	}
+}
+
+void PackedTiles::replace_if(size_t row, size_t col, size_t rows, size_t cols,
+		const ValueMask& pred, uint8_t value)
+{
+	assert(row + rows <= numRows() && col + cols <= mCols);
+	assert(value <= MAX_VALUE);
+	if(!cols)
+		return;
+
+	const size_t first = (col + 1) / 2, last = (col + cols) / 2;
+	for(size_t r = row; r < row + rows; ++r) {
+		Row tiles = (*this)[r];
+		if(col & 1 && pred(uint8_t(tiles[col])))
+			tiles[col] = value;
+
+		// Even and odd tiles of each byte tested apart, in place
+		uint8_t* bytes = &mBytes[r][0];
+		size_t b = first;
+#ifdef __SSE2__
+		const __m128i low = _mm_set1_epi8(MAX_VALUE);
+		const __m128i with = _mm_set1_epi8(value);
+		for(; b + 16 <= last; b += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(bytes + b));
+			const __m128i even = _mm_and_si128(v, low);
+			const __m128i odd = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+			const __m128i in_even = in_mask(even, pred.mask);
+			const __m128i in_odd = in_mask(odd, pred.mask);
+			const __m128i new_even = _mm_or_si128(_mm_and_si128(in_even, with),
+				_mm_andnot_si128(in_even, even));
+			const __m128i new_odd = _mm_or_si128(_mm_and_si128(in_odd, with),
+				_mm_andnot_si128(in_odd, odd));
+			_mm_storeu_si128((__m128i*)(bytes + b),
+				_mm_or_si128(new_even, _mm_slli_epi16(new_odd, 4)));
+		}
+#endif
+		for(; b < last; ++b) {
+			uint8_t even = bytes[b] & MAX_VALUE, odd = bytes[b] >> 4;
+			if(pred(even))
+				even = value;
+			if(pred(odd))
+				odd = value;
+			bytes[b] = even | (odd << 4);
+		}
+
+		const size_t end = col + cols - 1;
+		if(!(end & 1) && pred(uint8_t(tiles[end])))
+			tiles[end] = value;
+	}
+}
+
+size_t PackedTiles::count_if(size_t row, size_t col, size_t rows, size_t cols,
+		const ValueMask& pred) const
+{
+	assert(row + rows <= numRows() && col + cols <= mCols);
+	if(!cols)
+		return 0;
+
+	const size_t first = (col + 1) / 2, last = (col + cols) / 2;
+	size_t count = 0;
+	for(size_t r = row; r < row + rows; ++r) {
+		ConstRow tiles = (*this)[r];
+		if(col & 1)
+			count += pred(tiles[col]);
+
+		const uint8_t* bytes = &mBytes[r][0];
+		size_t b = first;
+#ifdef __SSE2__
+		const __m128i low = _mm_set1_epi8(MAX_VALUE);
+		for(; b + 16 <= last; b += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(bytes + b));
+			const __m128i even = _mm_and_si128(v, low);
+			const __m128i odd = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+			count += __builtin_popcount(_mm_movemask_epi8(in_mask(even, pred.mask)))
+				+ __builtin_popcount(_mm_movemask_epi8(in_mask(odd, pred.mask)));
+		}
+#endif
+		for(; b < last; ++b)
+			count += pred(uint8_t(bytes[b] & MAX_VALUE)) + pred(uint8_t(bytes[b] >> 4));
+
+		const size_t end = col + cols - 1;
+		if(!(end & 1))
+			count += pred(tiles[end]);
+	}
+	return count;
+}
+
+HeapMatrix<uint8_t> PackedTiles::unpack() const
+{
+	HeapMatrix<uint8_t> map(numRows(), mCols);
+	for(size_t r = 0; r < numRows(); ++r)
+		unpack(r, 0, mCols, &map[r][0]);
+	return map;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include "heapmatrix.hpp"
+
+// A matrix of 4 bit tiles, two to a byte, the even column in the low
+// half: half the memory and cache traffic of HeapMatrix<uint8_t>, for
+// tile values up to 15. Single tiles are read and written the same way,
+// as map[row][col]; runs of a row are unpacked, packed and compared 32
+// tiles at a time with SSE2, and rectangles filled, tested and replaced
+// a byte at a time, or 16 bytes at a time.
+class PackedTiles
+{
+public:
+	static const uint8_t MAX_VALUE = 15;
+
+	// A tile, to write through.
+	class Reference
+	{
+	public:
+		Reference(uint8_t& byte, int shift):
+			mByte(byte), mShift(shift)
+		{}
+
+		operator uint8_t() const
+		{
+			return (mByte >> mShift) & MAX_VALUE;
+		}
+
+		Reference& operator=(uint8_t value)
+		{
+			assert(value <= MAX_VALUE);
+			mByte = (mByte & ~(MAX_VALUE << mShift)) | (value << mShift);
+			return *this;
+		}
+
+		Reference& operator=(const Reference& other)
+		{
+			return *this = uint8_t(other);
+		}
+
+	private:
+		uint8_t& mByte;
+		int mShift;
+	};
+
+	class Row
+	{
+	public:
+		explicit Row(uint8_t* bytes):
+			mBytes(bytes)
+		{}
+
+		Reference operator[](size_t col) const
+		{
+			return Reference(mBytes[col / 2], (col & 1) * 4);
+		}
+
+	private:
+		uint8_t* mBytes;
+	};
+
+	class ConstRow
+	{
+	public:
+		explicit ConstRow(const uint8_t* bytes):
+			mBytes(bytes)
+		{}
+
+		uint8_t operator[](size_t col) const
+		{
+			return (mBytes[col / 2] >> ((col & 1) * 4)) & MAX_VALUE;
+		}
+
+	private:
+		const uint8_t* mBytes;
+	};
+
+	PackedTiles():
+		mCols(0)
+	{}
+
+	PackedTiles(size_t rows, size_t cols, uint8_t value = 0):
+		mCols(cols),
+		mBytes(rows, (cols + 1) / 2, fill(value))
+	{}
+
+	// Pack a map of values up to MAX_VALUE.
+	explicit PackedTiles(const HeapMatrix<uint8_t>& map);
+
+	void resize(size_t rows, size_t cols, uint8_t value = 0)
+	{
+		mCols = cols;
+		mBytes.resize(rows, (cols + 1) / 2, fill(value));
+	}
+
+	Row operator[](size_t row)
+	{
+		return Row(&mBytes[row][0]);
+	}
+
+	ConstRow operator[](size_t row) const
+	{
+		return ConstRow(&mBytes[row][0]);
+	}
+
+	size_t numRows() const
+	{
+		return mBytes.numRows();
+	}
+
+	size_t numCols() const
+	{
+		return mCols;
+	}
+
+	size_t bytes() const
+	{
+		return mBytes.bytes();
+	}
+
+	// Tiles [col, col + n) of a row, one per byte of out.
+	void unpack(size_t row, size_t col, size_t n, uint8_t* out) const;
+
+	// Write n tiles, one per byte of in, to [col, col + n) of a row.
+	void pack(size_t row, size_t col, size_t n, const uint8_t* in);
+
+	// Set bit i of bits, 64 to a word, where tile col + i of a row
+	// equals value, for i < n; clear it elsewhere.
+	void match(size_t row, size_t col, size_t n, uint8_t value,
+		uint64_t* bits) const;
+
+	// Bulk operations on the rows [row, row + rows) and the columns
+	// [col, col + cols), as for HeapMatrix. Any test of 4 bit values is
+	// a ValueMask, so that is the only predicate.
+	void fill_rect(size_t row, size_t col, size_t rows, size_t cols,
+		uint8_t value);
+	void blit_rect(size_t row, size_t col, const PackedTiles& src,
+		size_t src_row, size_t src_col, size_t rows, size_t cols);
+	void replace_if(size_t row, size_t col, size_t rows, size_t cols,
+		const ValueMask& pred, uint8_t value);
+	size_t count_if(size_t row, size_t col, size_t rows, size_t cols,
+		const ValueMask& pred) const;
+
+	// The whole map, a tile per byte.
+	HeapMatrix<uint8_t> unpack() const;
+
+private:
+	static uint8_t fill(uint8_t value)
+	{
+		assert(value <= MAX_VALUE);
+		return value | (value << 4);
+	}
+
+	size_t mCols;
+	HeapMatrix<uint8_t> mBytes;
+};
@@ -0,0 +1,235 @@
+#include "pagedtiles.hpp"
+
+#include <string>
+#include <system_error>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+	int temp_file()
+	{
+		const char* dir = std::getenv("TMPDIR");
+		std::string path = std::string(dir ? dir : "/tmp") + "/tilesXXXXXX";
+		const int fd = mkstemp(&path[0]);
+		if(fd < 0)
+			throw std::system_error(errno, std::system_category(),
+				"Can't create " + path);
+		unlink(path.c_str());
+		return fd;
+	}
+
+	size_t system_page()
+	{
+		return sysconf(_SC_PAGESIZE);
+	}
+
+	// Close fd and throw the error of the last call that failed on it.
+	[[noreturn]] void fail(int fd, const std::string& what)
+	{
+		const int error = errno;
+		close(fd);
+		throw std::system_error(error, std::system_category(), what);
+	}
+
+	// At the start of the file, the shape of the map in it.
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t page_side;
+		uint64_t rows;
+		uint64_t cols;
+	};
+
+	const char MAGIC[8] = {'N', 'S', 'A', 'T', 'I', 'L', 'E', 'S'};
+	const uint32_t VERSION = 1;
+}
+
+PagedTiles::PagedTiles(size_t rows, size_t cols, uint8_t value):
+	mRows(rows), mCols(cols)
+{
+	map_file(temp_file(), "temporary tiles", false);
+	if(value)
+		for(size_t r = 0; r < mRows; ++r)
+			for(size_t c = 0; c < mCols; ++c)
+				set(r, c, value);
+}
+
+PagedTiles::PagedTiles(const char* path, size_t rows, size_t cols):
+	mRows(rows), mCols(cols)
+{
+	const int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+		throw std::system_error(errno, std::system_category(),
+			std::string("Can't open ") + path);
+	map_file(fd, path, true);
+}
+
+PagedTiles::PagedTiles(PagedTiles&& other):
+	mRows(other.mRows), mCols(other.mCols),
+	mPagesAcross(other.mPagesAcross),
+	mFd(other.mFd),
+	mData(other.mData),
+	mHeader(other.mHeader),
+	mSize(other.mSize),
+	mTouched(std::move(other.mTouched))
+{
+	other.mFd = -1;
+	other.mData = nullptr;
+	other.mSize = 0;
+}
+
+PagedTiles::~PagedTiles()
+{
+	if(mData)
+		munmap(mData - mHeader, mHeader + mSize);
+	if(mFd >= 0)
+		close(mFd);
+}
+
+void PagedTiles::map_file(int fd, const std::string& path, bool keep)
+{
+	mFd = fd;
+	mData = nullptr;
+	mPagesAcross = (mCols + PAGE_SIDE - 1) / PAGE_SIDE;
+	const size_t pages = (mRows + PAGE_SIDE - 1) / PAGE_SIDE * mPagesAcross;
+	mSize = pages * PAGE_BYTES;
+	mTouched.assign(pages, false);
+
+	// The header takes whole system pages, so that the tiles stay
+	// aligned to them for msync() and madvise().
+	mHeader = std::max(size_t(PAGE_BYTES), system_page());
+
+	Header header;
+	struct stat st;
+	const bool same = keep && fstat(fd, &st) == 0
+		&& size_t(st.st_size) == mHeader + mSize
+		&& pread(fd, &header, sizeof header, 0) == ssize_t(sizeof header)
+		&& std::memcmp(header.magic, MAGIC, sizeof MAGIC) == 0
+		&& header.version == VERSION && header.page_side == PAGE_SIDE
+		&& header.rows == mRows && header.cols == mCols;
+	if(same) {
+		// The pages holding data were written, the holes weren't.
+		// ENXIO means there is no data past the offset. Without
+		// SEEK_DATA support the rest of the file is taken as data, so
+		// that writing zeros over it isn't skipped.
+		const off_t end = mHeader + mSize;
+		off_t from = mHeader;
+		off_t data = lseek(fd, from, SEEK_DATA);
+		while(data >= 0 && data < end) {
+			off_t hole = lseek(fd, data, SEEK_HOLE);
+			if(hole < 0)
+				hole = end;
+			const size_t last = std::min(pages,
+				(hole - mHeader + PAGE_BYTES - 1) / PAGE_BYTES);
+			for(size_t p = (data - mHeader) / PAGE_BYTES; p < last; ++p)
+				mTouched[p] = true;
+			from = hole;
+			data = hole < end ? lseek(fd, hole, SEEK_DATA) : end;
+		}
+		if(data < 0 && errno != ENXIO)
+			std::fill(mTouched.begin() + (from - mHeader) / PAGE_BYTES,
+				mTouched.end(), true);
+	} else {
+		// Holes all over, after the header.
+		std::memset(&header, 0, sizeof header);
+		std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+		header.version = VERSION;
+		header.page_side = PAGE_SIDE;
+		header.rows = mRows;
+		header.cols = mCols;
+		if(ftruncate(fd, 0) != 0 || ftruncate(fd, mHeader + mSize) != 0)
+			fail(fd, "Can't size " + path);
+		const ssize_t written = pwrite(fd, &header, sizeof header, 0);
+		if(written != ssize_t(sizeof header)) {
+			if(written >= 0)
+				errno = EIO;
+			fail(fd, "Can't write the header of " + path);
+		}
+	}
+
+	if(mSize) {
+		void* data = mmap(nullptr, mHeader + mSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+		if(data == MAP_FAILED)
+			fail(fd, "Can't map " + path);
+		mData = static_cast<uint8_t*>(data) + mHeader;
+	}
+}
+
+void PagedTiles::read(size_t row, size_t col, size_t n, uint8_t* out) const
+{
+	// A page at a time.
+	while(n) {
+		const size_t run = std::min(n, PAGE_SIDE - col % PAGE_SIDE);
+		std::memcpy(out, at(row, col), run);
+		out += run;
+		col += run;
+		n -= run;
+	}
+}
+
+void PagedTiles::fill_rect(size_t row, size_t col, size_t rows, size_t cols,
+		uint8_t value)
+{
+	assert(row + rows <= mRows && col + cols <= mCols);
+	for(size_t r = row; r < row + rows; ++r) {
+		for(size_t c = col; c < col + cols; ) {
+			const size_t run = std::min(col + cols - c, PAGE_SIDE - c % PAGE_SIDE);
+			const size_t p = page(r, c);
+			if(mTouched[p] || value) {
+				mTouched[p] = true;
+				std::memset(at(r, c), value, run);
+			}
+			c += run;
+		}
+	}
+}
+
+size_t PagedTiles::bytes() const
+{
+	return std::count(mTouched.begin(), mTouched.end(), true) * PAGE_BYTES;
+}
+
+size_t PagedTiles::resident() const
+{
+	if(!mData)
+		return 0;
+
+	const size_t page = system_page();
+	std::vector<unsigned char> in_core((mSize + page - 1) / page);
+	if(mincore(mData, mSize, &in_core[0]) != 0)
+		return 0;
+
+	size_t pages = 0;
+	for(unsigned char p: in_core)
+		pages += p & 1;
+	return pages * page;
+}
+
+void PagedTiles::release(size_t first, size_t last)
+{
+	if(!mData || first >= last)
+		return;
+
+	// Page rows are contiguous in the file. Writing back and dropping
+	// pages keeps their data, so rounding out to system pages is
+	// harmless. Unmapped pages are only dropped from the file cache
+	// once written.
+	const size_t band = mPagesAcross * PAGE_BYTES;
+	const size_t page = system_page();
+	const size_t from = first / PAGE_SIDE * band / page * page;
+	const size_t to = std::min(mSize, (last + PAGE_SIDE - 1) / PAGE_SIDE * band);
+	if(from >= to)
+		return;
+
+	msync(mData + from, to - from, MS_SYNC);
+	madvise(mData + from, to - from, MADV_DONTNEED);
+	posix_fadvise(mFd, mHeader + from, to - from, POSIX_FADV_DONTNEED);
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// A matrix of byte tiles in a memory mapped file, for maps bigger than
+// memory. Tiles are laid out in square pages of one memory page each,
+// so a region of the map spans a few pages, which the system loads on
+// access, and writes back and evicts under memory pressure.
+//
+// The file is sparse: pages never written take no space, and writing
+// zero (Wempty) to them keeps it that way. Tiles are read and written
+// as map[row][col], like HeapMatrix<uint8_t>.
+//
+// Only generation works on maps this big (see BasicBlueprint): tracing
+// collision loops and building the render need the map in memory.
+//
+// A header page before the tiles holds the shape of the map, so that a
+// file is only taken back for a map of the same shape. Files that can't
+// be created, sized or mapped, e.g. on a full disk, throw
+// std::system_error from the constructors.
+class PagedTiles
+{
+public:
+	static const size_t PAGE_SIDE = 64;
+	static const size_t PAGE_BYTES = PAGE_SIDE * PAGE_SIDE;
+
+	// A tile, to write through.
+	class Reference
+	{
+	public:
+		Reference(PagedTiles& tiles, size_t row, size_t col):
+			mTiles(tiles), mRow(row), mCol(col)
+		{}
+
+		operator uint8_t() const
+		{
+			return *mTiles.at(mRow, mCol);
+		}
+
+		Reference& operator=(uint8_t value)
+		{
+			mTiles.set(mRow, mCol, value);
+			return *this;
+		}
+
+		Reference& operator=(const Reference& other)
+		{
+			return *this = uint8_t(other);
+		}
+
+	private:
+		PagedTiles& mTiles;
+		size_t mRow, mCol;
+	};
+
+	class Row
+	{
+	public:
+		Row(PagedTiles& tiles, size_t row):
+			mTiles(tiles), mRow(row)
+		{}
+
+		Reference operator[](size_t col) const
+		{
+			return Reference(mTiles, mRow, col);
+		}
+
+	private:
+		PagedTiles& mTiles;
+		size_t mRow;
+	};
+
+	class ConstRow
+	{
+	public:
+		ConstRow(const PagedTiles& tiles, size_t row):
+			mTiles(tiles), mRow(row)
+		{}
+
+		uint8_t operator[](size_t col) const
+		{
+			return *mTiles.at(mRow, col);
+		}
+
+	private:
+		const PagedTiles& mTiles;
+		size_t mRow;
+	};
+
+	// In a temporary file, deleted as soon as it is mapped.
+	PagedTiles(size_t rows, size_t cols, uint8_t value = 0);
+
+	// In a file that is kept, with the tiles it holds if it was made
+	// for a map of this shape, otherwise emptied.
+	PagedTiles(const char* path, size_t rows, size_t cols);
+
+	PagedTiles(PagedTiles&& other);
+	~PagedTiles();
+
+	PagedTiles(const PagedTiles&) = delete;
+	PagedTiles& operator=(const PagedTiles&) = delete;
+
+	Row operator[](size_t row)
+	{
+		return Row(*this, row);
+	}
+
+	ConstRow operator[](size_t row) const
+	{
+		return ConstRow(*this, row);
+	}
+
+	size_t numRows() const
+	{
+		return mRows;
+	}
+
+	size_t numCols() const
+	{
+		return mCols;
+	}
+
+	// Tiles [col, col + n) of a row, one per byte of out.
+	void read(size_t row, size_t col, size_t n, uint8_t* out) const;
+
+	// Set the tiles of rows [row, row + rows) and columns
+	// [col, col + cols), a run of a page at a time. Pages never written
+	// stay so when filled with zero.
+	void fill_rect(size_t row, size_t col, size_t rows, size_t cols,
+		uint8_t value);
+
+	// Whether the page of a tile was written to; all its tiles are
+	// zero otherwise.
+	bool touched(size_t row, size_t col) const
+	{
+		return mTouched[page(row, col)];
+	}
+
+	// Bytes taken in the file by the pages written to.
+	size_t bytes() const;
+
+	// Bytes of the map currently in memory.
+	size_t resident() const;
+
+	// Drop the pages of rows [first, last) from memory, once they are
+	// done with. They are written back, and read again on access.
+	void release(size_t first, size_t last);
+
+private:
+	void map_file(int fd, const std::string& path, bool keep);
+
+	size_t page(size_t row, size_t col) const
+	{
+		return row / PAGE_SIDE * mPagesAcross + col / PAGE_SIDE;
+	}
+
+	uint8_t* at(size_t row, size_t col) const
+	{
+		return mData + page(row, col) * PAGE_BYTES
+			+ row % PAGE_SIDE * PAGE_SIDE + col % PAGE_SIDE;
+	}
+
+	void set(size_t row, size_t col, uint8_t value)
+	{
+		const size_t p = page(row, col);
+		if(!mTouched[p]) {
+			if(!value)
+				return;
+			mTouched[p] = true;
+		}
+		*at(row, col) = value;
+	}
+
+	size_t mRows, mCols;
+	size_t mPagesAcross;
+	int mFd;
+	uint8_t* mData;		// the first tile page, after the header
+	size_t mHeader;
+	size_t mSize;		// of the tile pages
+	std::vector<bool> mTouched;
+};
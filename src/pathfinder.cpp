@@ -0,0 +1,510 @@
+#include "pathfinder.hpp"
+
+#include <queue>
+#include <limits>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+namespace {
+	const IVec2 NEIGHBOURS[4] = {
+		IVec2(0, 1),
+		IVec2(-1, 0),
+		IVec2(0, -1),
+		IVec2(1, 0)
+	};
+}
+
+Pathfinder::Pathfinder(const Blueprint& blueprint, const IVec2& dim):
+	mBlueprint(blueprint),
+	mTraversal(blueprint.getMap(), dim),
+	mDim(dim),
+	mRoomSize(Blueprint::COLS_PER_ROOM, Blueprint::ROWS_PER_ROOM),
+	mDirty(true)
+{
+	const IVec2& rooms = blueprint.getRooms();
+
+	mClusters.resize(rooms.y, rooms.x);
+	for(int d = 0; d < rooms.y; ++d) {
+		for(int a = 0; a < rooms.x; ++a) {
+			Cluster& c = mClusters[d][a];
+			c.pos = IVec2(a * mRoomSize.x, d * mRoomSize.y);
+			c.size.x = std::max(0, std::min(mRoomSize.x, dim.x - c.pos.x));
+			c.size.y = std::max(0, std::min(mRoomSize.y, dim.y - c.pos.y));
+			c.dirty = true;
+		}
+	}
+
+	Border border;
+	border.trustBlueprint = true;
+	border.dirty = true;
+	mDownBorders.resize(std::max(0, rooms.y - 1), rooms.x, border);
+	mAcrossBorders.resize(rooms.y, std::max(0, rooms.x - 1), border);
+}
+
+bool Pathfinder::find_path(const IVec2& start, const IVec2& goal,
+		std::vector<IVec2>& path)
+{
+	path.clear();
+	if(!mTraversal.passable(start.y, start.x)
+			|| !mTraversal.passable(goal.y, goal.x))
+		return false;
+
+	refresh();
+
+	const Cluster& sc = cluster_at(start);
+	const Cluster& gc = cluster_at(goal);
+
+	// Within the same room, try the direct way first.
+	mStartSearch.run(mTraversal, sc, start, false);
+	if(&sc == &gc && mStartSearch.cost(goal) >= 0) {
+		path.push_back(start);
+		append_forward(mStartSearch, goal, path);
+		return true;
+	}
+	mGoalSearch.run(mTraversal, gc, goal, true);
+
+	// A* over the entrances, with an extra node for the goal.
+	const int GOAL = mNodes.size();
+	const int INF = std::numeric_limits<int>::max();
+	std::vector<int> g(GOAL + 1, INF);
+	std::vector<int> came(GOAL + 1, -1);
+
+	typedef std::pair<int, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+
+	auto heuristic = [&](int node) {
+		if(node == GOAL)
+			return 0;
+		IVec2 t = tile(mNodes[node].tile);
+		return std::abs(t.x - goal.x) + std::abs(t.y - goal.y);
+	};
+	auto relax = [&](int from, int node, int cost) {
+		if(cost < g[node]) {
+			g[node] = cost;
+			came[node] = from;
+			open.push(Entry(cost + heuristic(node), node));
+		}
+	};
+
+	std::vector<int> starts, goals;
+	for(int e: sc.entrances)
+		if(mStartSearch.cost(tile(e)) >= 0)
+			starts.push_back(mNodeAt[e]);
+	for(int e: gc.entrances)
+		if(mGoalSearch.cost(tile(e)) >= 0)
+			goals.push_back(mNodeAt[e]);
+
+	bool reachable = false;
+	for(int s: starts)
+		for(int e: goals)
+			reachable = reachable || may_reach(s, e);
+	if(!reachable)
+		return false;
+
+	for(int s: starts)
+		relax(-1, s, mStartSearch.cost(tile(mNodes[s].tile)));
+
+	while(!open.empty()) {
+		Entry top = open.top();
+		open.pop();
+
+		int n = top.second;
+		if(n == GOAL)
+			break;
+		if(top.first != g[n] + heuristic(n))
+			continue;
+
+		const Node& node = mNodes[n];
+		const Cluster& c = mClusters[node.room.y][node.room.x];
+		if(&c == &gc) {
+			int cost = mGoalSearch.cost(tile(node.tile));
+			if(cost >= 0)
+				relax(n, GOAL, g[n] + cost);
+		}
+		for(int to: node.links)
+			relax(n, to, g[n] + 1);
+		for(const IntraEdge& e: c.edges[node.slot])
+			relax(n, e.node, g[n] + e.cost);
+	}
+
+	if(g[GOAL] == INF)
+		return false;
+
+	// Refine: tile paths between the entrances on the way.
+	std::vector<int> route;
+	for(int n = came[GOAL]; n >= 0; n = came[n])
+		route.push_back(n);
+	std::reverse(route.begin(), route.end());
+
+	path.push_back(start);
+	append_forward(mStartSearch, tile(mNodes[route.front()].tile), path);
+	for(size_t i = 1; i < route.size(); ++i) {
+		const Node& prev = mNodes[route[i - 1]];
+		const Node& cur = mNodes[route[i]];
+		if(prev.room == cur.room) {
+			const Cluster& c = mClusters[prev.room.y][prev.room.x];
+			for(const IntraEdge& e: c.edges[prev.slot]) {
+				if(e.to == cur.tile) {
+					path.insert(path.end(), e.path.begin(), e.path.end());
+					break;
+				}
+			}
+		} else {
+			path.push_back(tile(cur.tile));
+		}
+	}
+	append_reverse(mGoalSearch, tile(mNodes[route.back()].tile), path);
+
+	return true;
+}
+
+void Pathfinder::invalidate_room(int across, int down)
+{
+	mClusters[down][across].dirty = true;
+
+	// Entrances to the neighbours may have changed as well.
+	Border* borders[4] = {
+		down > 0 ? &mDownBorders[down - 1][across] : nullptr,
+		down < int(mDownBorders.numRows()) ? &mDownBorders[down][across] : nullptr,
+		across > 0 ? &mAcrossBorders[down][across - 1] : nullptr,
+		across < int(mAcrossBorders.numCols()) ? &mAcrossBorders[down][across] : nullptr,
+	};
+	for(Border* b: borders) {
+		if(b) {
+			b->dirty = true;
+			b->trustBlueprint = false;
+		}
+	}
+
+	mDirty = true;
+}
+
+void Pathfinder::invalidate_tile(const IVec2& tile)
+{
+	invalidate_room(tile.x / mRoomSize.x, tile.y / mRoomSize.y);
+}
+
+Pathfinder::Cluster& Pathfinder::cluster_at(const IVec2& tile)
+{
+	return mClusters[tile.y / mRoomSize.y][tile.x / mRoomSize.x];
+}
+
+void Pathfinder::refresh()
+{
+	if(!mDirty)
+		return;
+
+	const IVec2& rooms = mBlueprint.getRooms();
+	for(int d = 0; d < rooms.y; ++d) {
+		for(int a = 0; a < rooms.x; ++a) {
+			if(d + 1 < rooms.y && mDownBorders[d][a].dirty) {
+				scan_border(mDownBorders[d][a], IVec2(a, d), IVec2(a, d + 1));
+				mClusters[d][a].dirty = mClusters[d + 1][a].dirty = true;
+			}
+			if(a + 1 < rooms.x && mAcrossBorders[d][a].dirty) {
+				scan_border(mAcrossBorders[d][a], IVec2(a, d), IVec2(a + 1, d));
+				mClusters[d][a].dirty = mClusters[d][a + 1].dirty = true;
+			}
+		}
+	}
+
+	for(int d = 0; d < rooms.y; ++d)
+		for(int a = 0; a < rooms.x; ++a)
+			if(mClusters[d][a].dirty)
+				build_cluster(mClusters[d][a]);
+
+	link_graph();
+	mDirty = false;
+}
+
+void Pathfinder::scan_border(Border& border, const IVec2& a, const IVec2& b)
+{
+	border.links.clear();
+	border.dirty = false;
+
+	const bool down = b.y != a.y;
+	if(border.trustBlueprint) {
+		bool wall = down ? mBlueprint.getHorizBounds()[b.y][b.x]
+			: mBlueprint.getVertBounds()[b.y][b.x];
+		if(wall)
+			return;
+	}
+
+	const Cluster& ca = mClusters[a.y][a.x];
+	const Cluster& cb = mClusters[b.y][b.x];
+
+	// Tiles facing each other across the border, and where the
+	// blueprint has put the way across: the ladder going down, or
+	// just above the floor going sideways.
+	int len;
+	int preferred;
+	IVec2 pa, pb, step;
+	if(down) {
+		len = std::min(ca.size.x, cb.size.x);
+		preferred = mBlueprint.getMiddleCols()[a.x];
+		pa = IVec2(ca.pos.x, ca.pos.y + ca.size.y - 1);
+		pb = cb.pos;
+		step = IVec2(1, 0);
+	} else {
+		len = std::min(ca.size.y, cb.size.y);
+		preferred = mBlueprint.getMiddleRows()[a.y] - 1;
+		pa = IVec2(ca.pos.x + ca.size.x - 1, ca.pos.y);
+		pb = cb.pos;
+		step = IVec2(0, 1);
+	}
+
+	// One entrance per run of crossable tiles, in each direction. Moves
+	// are not all reversible (falling is not), so a run only goes on
+	// while one can go back and forth between its tiles on both sides:
+	// that keeps any crossing of the run as good as its entrance.
+	auto both_ways = [&](const IVec2& p, const IVec2& q) {
+		return mTraversal.can_move(p, q) && mTraversal.can_move(q, p);
+	};
+
+	for(int dir = 0; dir < 2; ++dir) {
+		const IVec2 from0 = dir ? pb : pa;
+		const IVec2 to0 = dir ? pa : pb;
+
+		int run = -1;
+		for(int i = 0; i <= len; ++i) {
+			const IVec2 from = from0 + step * i;
+			const IVec2 to = to0 + step * i;
+			bool ok = i < len && mTraversal.passable(from.y, from.x)
+				&& mTraversal.can_move(from, to);
+			bool joined = ok && run >= 0
+				&& both_ways(from - step, from) && both_ways(to - step, to);
+
+			if(run >= 0 && !joined) {
+				int pick = std::min(std::max(preferred, run), i - 1);
+				Link link;
+				link.from = index(from0 + step * pick);
+				link.to = index(to0 + step * pick);
+				border.links.push_back(link);
+				run = -1;
+			}
+			if(ok && run < 0)
+				run = i;
+		}
+	}
+}
+
+void Pathfinder::build_cluster(Cluster& c)
+{
+	c.entrances.clear();
+	c.edges.clear();
+	c.dirty = false;
+
+	const int across = c.pos.x / mRoomSize.x;
+	const int down = c.pos.y / mRoomSize.y;
+	const Border* borders[4] = {
+		down > 0 ? &mDownBorders[down - 1][across] : nullptr,
+		down < int(mDownBorders.numRows()) ? &mDownBorders[down][across] : nullptr,
+		across > 0 ? &mAcrossBorders[down][across - 1] : nullptr,
+		across < int(mAcrossBorders.numCols()) ? &mAcrossBorders[down][across] : nullptr,
+	};
+	for(const Border* b: borders) {
+		if(!b)
+			continue;
+		for(const Link& l: b->links) {
+			if(&cluster_at(tile(l.from)) == &c)
+				c.entrances.push_back(l.from);
+			if(&cluster_at(tile(l.to)) == &c)
+				c.entrances.push_back(l.to);
+		}
+	}
+	std::sort(c.entrances.begin(), c.entrances.end());
+	c.entrances.erase(std::unique(c.entrances.begin(), c.entrances.end()),
+		c.entrances.end());
+
+	// Tile paths between every pair of entrances, one search each.
+	c.edges.resize(c.entrances.size());
+	for(size_t i = 0; i < c.entrances.size(); ++i) {
+		mScratch.run(mTraversal, c, tile(c.entrances[i]), false);
+		for(size_t j = 0; j < c.entrances.size(); ++j) {
+			IVec2 to = tile(c.entrances[j]);
+			int cost = mScratch.cost(to);
+			if(i == j || cost < 0)
+				continue;
+
+			IntraEdge e;
+			e.to = c.entrances[j];
+			e.cost = cost;
+			append_forward(mScratch, to, e.path);
+			c.edges[i].push_back(e);
+		}
+	}
+}
+
+void Pathfinder::link_graph()
+{
+	mNodes.clear();
+	mNodeAt.clear();
+
+	for(size_t d = 0; d < mClusters.numRows(); ++d) {
+		for(size_t a = 0; a < mClusters.numCols(); ++a) {
+			const Cluster& c = mClusters[d][a];
+			for(size_t i = 0; i < c.entrances.size(); ++i) {
+				Node n;
+				n.tile = c.entrances[i];
+				n.room = IVec2(a, d);
+				n.slot = i;
+				mNodeAt[n.tile] = mNodes.size();
+				mNodes.push_back(n);
+			}
+		}
+	}
+
+	for(HeapMatrix<Border>* borders: {&mDownBorders, &mAcrossBorders})
+		for(size_t r = 0; r < borders->numRows(); ++r)
+			for(const Border& b: (*borders)[r])
+				for(const Link& l: b.links)
+					mNodes[mNodeAt[l.from]].links.push_back(mNodeAt[l.to]);
+
+	for(size_t d = 0; d < mClusters.numRows(); ++d)
+		for(Cluster& c: mClusters[d])
+			for(auto& edges: c.edges)
+				for(IntraEdge& e: edges)
+					e.node = mNodeAt[e.to];
+
+	label_components();
+}
+
+void Pathfinder::label_components()
+{
+	const int count = mNodes.size();
+
+	std::vector<int> succ, first(count + 1, 0);
+	for(int n = 0; n < count; ++n) {
+		const Node& node = mNodes[n];
+		succ.insert(succ.end(), node.links.begin(), node.links.end());
+		for(const IntraEdge& e: mClusters[node.room.y][node.room.x].edges[node.slot])
+			succ.push_back(e.node);
+		first[n + 1] = succ.size();
+	}
+
+	// Tarjan's algorithm, without recursion. Components come out
+	// in reverse topological order.
+	mComponent.assign(count, -1);
+	std::vector<int> index(count, -1), low(count), stack, order;
+	std::vector<std::pair<int, int> > calls;
+	int counter = 0, components = 0;
+	for(int root = 0; root < count; ++root) {
+		if(index[root] >= 0)
+			continue;
+
+		index[root] = low[root] = counter++;
+		stack.push_back(root);
+		calls.push_back(std::make_pair(root, first[root]));
+		while(!calls.empty()) {
+			const int v = calls.back().first;
+			if(calls.back().second < first[v + 1]) {
+				const int w = succ[calls.back().second++];
+				if(index[w] < 0) {
+					index[w] = low[w] = counter++;
+					stack.push_back(w);
+					calls.push_back(std::make_pair(w, first[w]));
+				} else if(mComponent[w] < 0) {
+					low[v] = std::min(low[v], index[w]);
+				}
+				continue;
+			}
+
+			calls.pop_back();
+			if(!calls.empty()) {
+				int& parent_low = low[calls.back().first];
+				parent_low = std::min(parent_low, low[v]);
+			}
+			if(low[v] == index[v]) {
+				int w;
+				do {
+					w = stack.back();
+					stack.pop_back();
+					mComponent[w] = components;
+					order.push_back(w);
+				} while(w != v);
+				++components;
+			}
+		}
+	}
+
+	// Components reachable from another one have lower numbers,
+	// so they are done by the time they are needed.
+	mComponentLow.resize(components);
+	for(int c = 0; c < components; ++c)
+		mComponentLow[c] = c;
+	for(int v: order)
+		for(int i = first[v]; i < first[v + 1]; ++i)
+			mComponentLow[mComponent[v]] = std::min(
+				mComponentLow[mComponent[v]],
+				mComponentLow[mComponent[succ[i]]]);
+}
+
+void Pathfinder::append_forward(const Search& s, const IVec2& to,
+		std::vector<IVec2>& path) const
+{
+	const size_t first = path.size();
+	for(int l = s.local(to); s.parent[l] >= 0; l = s.parent[l])
+		path.push_back(s.tile(l));
+	std::reverse(path.begin() + first, path.end());
+}
+
+void Pathfinder::append_reverse(const Search& s, const IVec2& from,
+		std::vector<IVec2>& path) const
+{
+	for(int l = s.parent[s.local(from)]; l >= 0; l = s.parent[l])
+		path.push_back(s.tile(l));
+}
+
+void Pathfinder::Search::run(const Traversal& traversal, const Cluster& room,
+		const IVec2& origin, bool reverse)
+{
+	pos = room.pos;
+	size = room.size;
+	dist.assign(size.x * size.y, -1);
+	parent.assign(size.x * size.y, -1);
+	queue.clear();
+
+	dist[local(origin)] = 0;
+	queue.push_back(local(origin));
+
+	// Moves all cost the same, so breadth first is as good as A*.
+	for(size_t head = 0; head < queue.size(); ++head) {
+		const int cur = queue[head];
+		const IVec2 t = tile(cur);
+		for(const IVec2& delta: NEIGHBOURS) {
+			IVec2 n = t + delta;
+			if(n.x < pos.x || n.y < pos.y
+					|| n.x >= pos.x + size.x || n.y >= pos.y + size.y)
+				continue;
+
+			int l = local(n);
+			if(dist[l] >= 0 || !traversal.passable(n.y, n.x))
+				continue;
+			if(reverse ? !traversal.can_move(n, t) : !traversal.can_move(t, n))
+				continue;
+
+			dist[l] = dist[cur] + 1;
+			parent[l] = cur;
+			queue.push_back(l);
+		}
+	}
+}
+
+int Pathfinder::Search::cost(const IVec2& t) const
+{
+	if(t.x < pos.x || t.y < pos.y
+			|| t.x >= pos.x + size.x || t.y >= pos.y + size.y)
+		return -1;
+	return dist[local(t)];
+}
+
+int Pathfinder::Search::local(const IVec2& t) const
+{
+	return (t.y - pos.y) * size.x + (t.x - pos.x);
+}
+
+IVec2 Pathfinder::Search::tile(int l) const
+{
+	return IVec2(pos.x + l % size.x, pos.y + l / size.x);
+}
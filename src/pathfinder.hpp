@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+#include "blueprint.hpp"
+#include "traversal.hpp"
+
+// Hierarchical path finder (HPA*) over the rooms of a Blueprint.
+//
+// Rooms are the clusters: paths are planned over the graph of entrances
+// between adjacent rooms, then refined with tile paths inside each room,
+// which are cached. Changing tiles only invalidates the rooms involved.
+//
+// Not thread safe: searches share scratch buffers.
+class Pathfinder
+{
+public:
+	// Only the first dim.y rows and dim.x columns of the map are used;
+	// the blueprint must outlive the path finder.
+	Pathfinder(const Blueprint& blueprint, const IVec2& dim);
+
+	// Path from start to goal, both included, in map tiles, following
+	// Traversal rules. Returns false, with an empty path, if goal
+	// can't be reached.
+	bool find_path(const IVec2& start, const IVec2& goal,
+		std::vector<IVec2>& path);
+
+	// Tiles of a room changed, forget what is known about it.
+	void invalidate_room(int across, int down);
+
+	// A tile changed, forget about its room (and the neighbouring
+	// one, for tiles at a room boundary).
+	void invalidate_tile(const IVec2& tile);
+
+private:
+	// A move from one room to the adjacent one, in tile indices.
+	struct Link {
+		int from;
+		int to;
+	};
+
+	// Entrances between two adjacent rooms.
+	struct Border {
+		std::vector<Link> links;
+		// The blueprint walls are only trusted until the tiles change.
+		bool trustBlueprint;
+		bool dirty;
+	};
+
+	// Cached tile path between two entrances of a room.
+	struct IntraEdge {
+		int to;
+		// Abstract graph node of to.
+		int node;
+		int cost;
+		// Excludes the first tile, includes the last.
+		std::vector<IVec2> path;
+	};
+
+	struct Cluster {
+		IVec2 pos;
+		IVec2 size;
+		std::vector<int> entrances;
+		// Parallel to entrances.
+		std::vector<std::vector<IntraEdge> > edges;
+		bool dirty;
+	};
+
+	// Breadth first search restricted to a room.
+	struct Search {
+		IVec2 pos;
+		IVec2 size;
+		// Per tile of the room, -1 when not reached.
+		std::vector<int> dist;
+		// Previous tile on the way from the origin (going forward),
+		// or next tile on the way to it (going in reverse).
+		std::vector<int> parent;
+		std::vector<int> queue;
+
+		void run(const Traversal& traversal, const Cluster& room,
+			const IVec2& origin, bool reverse);
+		int cost(const IVec2& tile) const;
+		int local(const IVec2& tile) const;
+		IVec2 tile(int local) const;
+	};
+
+	int index(const IVec2& tile) const
+	{
+		return tile.y * mDim.x + tile.x;
+	}
+
+	IVec2 tile(int index) const
+	{
+		return IVec2(index % mDim.x, index / mDim.x);
+	}
+
+	Cluster& cluster_at(const IVec2& tile);
+
+	void refresh();
+	void scan_border(Border& border, const IVec2& a, const IVec2& b);
+	void build_cluster(Cluster& c);
+	void link_graph();
+	void label_components();
+
+	// False if there is surely no way between two nodes.
+	bool may_reach(int from, int to) const
+	{
+		const int a = mComponent[from], b = mComponent[to];
+		return b <= a && mComponentLow[a] <= mComponentLow[b];
+	}
+
+	// Tile path from the end of one search to the other, appended.
+	void append_forward(const Search& s, const IVec2& to,
+		std::vector<IVec2>& path) const;
+	void append_reverse(const Search& s, const IVec2& from,
+		std::vector<IVec2>& path) const;
+
+	const Blueprint& mBlueprint;
+	Traversal mTraversal;
+	IVec2 mDim;
+	IVec2 mRoomSize;
+
+	HeapMatrix<Cluster> mClusters;
+	// Between rooms (down, across) and (down + 1, across).
+	HeapMatrix<Border> mDownBorders;
+	// Between rooms (down, across) and (down, across + 1).
+	HeapMatrix<Border> mAcrossBorders;
+	bool mDirty;
+
+	// Abstract graph, rebuilt from the above when anything is dirty.
+	struct Node {
+		int tile;
+		IVec2 room;
+		int slot;
+		std::vector<int> links;
+	};
+	std::vector<Node> mNodes;
+	std::unordered_map<int, int> mNodeAt;
+
+	// Strongly connected component of each node, numbered so that
+	// reachable components come first, and lowest component reachable
+	// from each one. Failed searches would otherwise go through all
+	// the level reachable from the start before giving up.
+	std::vector<int> mComponent;
+	std::vector<int> mComponentLow;
+
+	Search mStartSearch, mGoalSearch, mScratch;
+};
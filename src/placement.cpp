@@ -0,0 +1,190 @@
+#include "placement.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+void PlacementIndex::build(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		const IVec2& window, uint8_t open)
+{
+	mRead = [&map](int row, int col, int) {
+		return &map[row][col];
+	};
+	index(dim, window, open);
+}
+
+void PlacementIndex::build(const PackedTiles& map, const IVec2& dim,
+		const IVec2& window, uint8_t open)
+{
+	mRead = [&map, this](int row, int col, int n) {
+		mTiles.resize(n);
+		map.unpack(row, col, n, mTiles.data());
+		return mTiles.data();
+	};
+	index(dim, window, open);
+}
+
+void PlacementIndex::build(const PagedTiles& map, const IVec2& dim,
+		const IVec2& window, uint8_t open)
+{
+	mRead = [&map, this](int row, int col, int n) {
+		mTiles.resize(n);
+		map.read(row, col, n, mTiles.data());
+		return mTiles.data();
+	};
+	index(dim, window, open);
+}
+
+void PlacementIndex::index(const IVec2& dim, const IVec2& window, uint8_t open)
+{
+	assert(window.x * window.y <= std::numeric_limits<uint16_t>::max());
+
+	mDim = dim;
+	mWindow = window;
+	mOpen = open;
+	mPositions = IVec2(std::max(dim.x - window.x + 1, 0),
+		std::max(dim.y - window.y + 1, 0));
+
+	const size_t count = size_t(mPositions.x) * mPositions.y;
+	mBits.assign((count + 63) / 64, 0);
+	mBlocks.clear();
+	mSize = 0;
+	if(!count)
+		return;
+
+	scan(IVec2(0, 0), mPositions - IVec2(1, 1), false);
+
+	std::vector<int64_t> blocks((mBits.size() + BLOCK_WORDS - 1) / BLOCK_WORDS, 0);
+	for(size_t i = 0; i < mBits.size(); ++i)
+		blocks[i / BLOCK_WORDS] += __builtin_popcountll(mBits[i]);
+	mBlocks.assign(blocks);
+	mSize = mBlocks.total();
+}
+
+void PlacementIndex::clear()
+{
+	mRead = nullptr;
+	mPositions = IVec2(0, 0);
+	mBits.clear();
+	mBlocks.clear();
+	mSize = 0;
+}
+
+void PlacementIndex::set_tile(const IVec2& tile, uint8_t old, uint8_t value)
+{
+	const bool was_open = old == mOpen;
+	const bool open = value == mOpen;
+	if(!mRead || was_open == open
+			|| tile.x < 0 || tile.y < 0 || tile.x >= mDim.x || tile.y >= mDim.y)
+		return;
+
+	// Every window position over the tile.
+	const IVec2 from(std::max(tile.x - mWindow.x + 1, 0),
+		std::max(tile.y - mWindow.y + 1, 0));
+	const IVec2 to(std::min(tile.x, mPositions.x - 1),
+		std::min(tile.y, mPositions.y - 1));
+	if(from.x > to.x || from.y > to.y)
+		return;
+
+	if(open) {
+		scan(from, to, true);
+	} else {
+		for(int r = from.y; r <= to.y; ++r)
+			clear_range(size_t(r) * mPositions.x + from.x,
+				size_t(r) * mPositions.x + to.x + 1);
+	}
+}
+
+IVec2 PlacementIndex::at(size_t i) const
+{
+	assert(i < mSize);
+
+	// Find the block, then the word, holding the i-th position...
+	int64_t k = i;
+	size_t word = mBlocks.find(k) * BLOCK_WORDS;
+	i = k;
+	for(;; ++word) {
+		const size_t n = __builtin_popcountll(mBits[word]);
+		if(i < n)
+			break;
+		i -= n;
+	}
+
+	// ...then drop the lower bits set before it.
+	uint64_t bits = mBits[word];
+	for(; i; --i)
+		bits &= bits - 1;
+	const size_t pos = word * 64 + __builtin_ctzll(bits);
+	return IVec2(pos % mPositions.x, pos / mPositions.x);
+}
+
+void PlacementIndex::scan(const IVec2& from, const IVec2& to, bool count)
+{
+	// Closed tiles in window.x wide runs of each row, from the row's
+	// prefix sums, summed over the last window.y rows, kept in a ring.
+	const int width = to.x - from.x + 1;
+	mPrefix.resize(width + mWindow.x);
+	mRuns.assign(mWindow.y * width, 0);
+	mSums.assign(width, 0);
+	for(int r = from.y; r < to.y + mWindow.y; ++r) {
+		const uint8_t* tiles = mRead(r, from.x, width + mWindow.x - 1);
+		int n = 0;
+		for(int i = 0; i < width + mWindow.x - 1; ++i) {
+			n += tiles[i] != mOpen;
+			mPrefix[i + 1] = n;
+		}
+
+		uint16_t* run = &mRuns[(r - from.y) % mWindow.y * width];
+		for(int i = 0; i < width; ++i) {
+			const uint16_t closed = mPrefix[i + mWindow.x] - mPrefix[i];
+			mSums[i] += closed - run[i];
+			run[i] = closed;
+		}
+
+		const int pos_row = r - mWindow.y + 1;
+		if(pos_row < from.y)
+			continue;
+		const size_t first = size_t(pos_row) * mPositions.x + from.x;
+		if(count) {
+			for(int i = 0; i < width; ++i)
+				set(first + i, !mSums[i]);
+		} else {
+			// Building: the bits are all clear, and counted afterwards.
+			for(int i = 0; i < width; ++i) {
+				const size_t pos = first + i;
+				mBits[pos / 64] |= uint64_t(!mSums[i]) << (pos % 64);
+			}
+		}
+	}
+}
+
+void PlacementIndex::set(size_t pos, bool valid)
+{
+	uint64_t& word = mBits[pos / 64];
+	const uint64_t bit = uint64_t(1) << (pos % 64);
+	if(bool(word & bit) == valid)
+		return;
+
+	word ^= bit;
+	const int delta = valid ? 1 : -1;
+	mSize += delta;
+	mBlocks.add(pos / 64 / BLOCK_WORDS, delta);
+}
+
+void PlacementIndex::clear_range(size_t first, size_t last)
+{
+	while(first < last) {
+		const size_t word = first / 64;
+		const size_t end = std::min(last, (word + 1) * 64);
+		const size_t len = end - first;
+		const uint64_t mask = (len == 64 ? ~uint64_t(0)
+			: (uint64_t(1) << len) - 1) << (first % 64);
+
+		const int n = __builtin_popcountll(mBits[word] & mask);
+		mBits[word] &= ~mask;
+		mSize -= n;
+		if(n)
+			mBlocks.add(word / BLOCK_WORDS, -n);
+		first = end;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "heapmatrix.hpp"
+#include "fenwick.hpp"
+#include "packedtiles.hpp"
+#include "pagedtiles.hpp"
+#include "vec2.hpp"
+
+// The places where a window of a given size, entirely inside the map,
+// covers only open tiles, kept up to date as tiles are written. Picking
+// one of them at random replaces trying random places until one fits,
+// whose cost grows with how crowded the map is.
+//
+// Window positions are a bitset, with the number of positions in each
+// block of words in a FenwickTree, to find the i-th one without counting
+// them all, in logarithmic time on either side: tiles are written much
+// more often than places are picked, but mega-levels have too many
+// blocks to go through them one by one. Closing a tile clears the
+// positions of the windows over it; opening one checks those windows
+// again. The bitset covers the whole map, whatever holds the tiles.
+class PlacementIndex
+{
+public:
+	PlacementIndex() = default;
+
+	// Index the windows of the first dim.y rows and dim.x columns of
+	// map, where tiles equal to open are open. The map must outlive
+	// the index, or clear() be called first.
+	void build(const HeapMatrix<uint8_t>& map, const IVec2& dim,
+		const IVec2& window, uint8_t open);
+	void build(const PackedTiles& map, const IVec2& dim,
+		const IVec2& window, uint8_t open);
+	void build(const PagedTiles& map, const IVec2& dim,
+		const IVec2& window, uint8_t open);
+
+	// Forget everything, set_tile() does nothing until build().
+	void clear();
+
+	// A tile of the map changed from old to value.
+	void set_tile(const IVec2& tile, uint8_t old, uint8_t value);
+
+	size_t size() const
+	{
+		return mSize;
+	}
+
+	// Top left tile of the i-th window fitting, i < size().
+	IVec2 at(size_t i) const;
+
+private:
+	// Words of mBits per count in mBlocks.
+	static const size_t BLOCK_WORDS = 64;
+
+	void index(const IVec2& dim, const IVec2& window, uint8_t open);
+
+	// Check the windows at positions [from, to], setting their bits,
+	// and updating the counts unless they are recounted afterwards.
+	void scan(const IVec2& from, const IVec2& to, bool count);
+	void set(size_t pos, bool valid);
+	// Clear positions [first, last).
+	void clear_range(size_t first, size_t last);
+
+	// n tiles of a row of the map indexed, from a column, a byte each.
+	std::function<const uint8_t*(int row, int col, int n)> mRead;
+	IVec2 mDim;
+	IVec2 mWindow;
+	// Number of window positions across and down.
+	IVec2 mPositions;
+	uint8_t mOpen;
+
+	std::vector<uint64_t> mBits;
+	FenwickTree mBlocks;
+	size_t mSize = 0;
+
+	// Scratch for scan().
+	std::vector<uint16_t> mPrefix, mRuns, mSums;
+	std::vector<uint8_t> mTiles;
+};
@@ -0,0 +1,269 @@
+#include "reachability.hpp"
+#include "blueprint.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+namespace {
+	typedef uint64_t Word;
+
+	Word reverse_word(Word x)
+	{
+		x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+		x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+		x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+		return __builtin_bswap64(x);
+	}
+
+	const uint64_t ONES = 0x0101010101010101ull;
+	const uint64_t HIGHS = 0x8080808080808080ull;
+
+	// Bit i set for each of 8 tiles, loaded as a little endian word,
+	// equal to t: bytes are zero where the xor is, so adding 0x7f
+	// doesn't carry into their high bit, and a multiply gathers those.
+	uint64_t equal8(uint64_t tiles, uint8_t t)
+	{
+		const uint64_t x = tiles ^ (ONES * t);
+		const uint64_t zero = ~(((x & ~HIGHS) + ~HIGHS) | x) & HIGHS;
+		return ((zero >> 7) * 0x0102040810204080ull) >> 56;
+	}
+
+	// Bits of the column on the left, and on the right, of each one.
+	void from_left(const Word* bits, Word* out, int words)
+	{
+		for(int w = 0; w < words; ++w)
+			out[w] = (bits[w] << 1) | (w > 0 ? bits[w - 1] >> 63 : 0);
+	}
+
+	void from_right(const Word* bits, Word* out, int words)
+	{
+		for(int w = 0; w < words; ++w)
+			out[w] = (bits[w] >> 1) | (w + 1 < words ? bits[w + 1] << 63 : 0);
+	}
+
+	// Add to bits the tiles reached from them going towards higher
+	// bits, through tiles set in moves. Adding bits to moves | bits,
+	// a carry goes into the bit after each of bits, and on while the
+	// bits it goes into are set: the carries in are the bits reached,
+	// and one past them.
+	void fill_up(Word* bits, const Word* moves, int words)
+	{
+		Word carry = 0;
+		for(int w = 0; w < words; ++w) {
+			const Word x = bits[w];
+			const Word a = moves[w] | x;
+			const Word sum = a + x;
+			const Word total = sum + carry;
+			carry = (sum < a) | (total < sum);
+			bits[w] = x | (moves[w] & (total ^ a ^ x));
+		}
+	}
+}
+
+Reachability::Reachability(const HeapMatrix<uint8_t>& map, const IVec2& dim):
+	mMap(map),
+	mDim(dim),
+	mWords((dim.x + BITS - 1) / BITS)
+{
+	assert(dim.x > 0 && dim.y > 0);
+
+	const size_t words = size_t(mWords) * dim.y;
+	mOpen.resize(words);
+	mClimb.resize(words);
+	mStanding.resize(words);
+	mWalk.right.resize(words);
+	mWalk.left.resize(words);
+	mLink.right.resize(words);
+	mLink.left.resize(words);
+	mReached.resize(words);
+	mLinked.resize(words);
+	mDirty.resize(dim.y);
+	mIn.resize(mWords);
+	mOut.resize(mWords);
+	update();
+}
+
+void Reachability::update()
+{
+	TRACE_SCOPE("Reachability::update");
+
+	std::vector<Word> left(mWords), right(mWords);
+	std::vector<Word> open_left(mWords), open_right(mWords), moves(mWords);
+	for(int r = 0; r < mDim.y; ++r) {
+		// Traversal rules, a word at a time
+		const uint8_t* tiles = &mMap[r][0];
+		const uint8_t* under = r + 1 < mDim.y ? &mMap[r + 1][0] : nullptr;
+		Word* open = row(mOpen, r);
+		Word* climb = row(mClimb, r);
+		Word* standing = row(mStanding, r);
+		for(int w = 0; w < mWords; ++w) {
+			const int n = std::min(BITS, mDim.x - w * BITS);
+			Word o = 0, c = 0, s = under ? 0 : ~Word(0);
+			int b = 0;
+			for(; b + 8 <= n; b += 8) {
+				uint64_t eight;
+				std::memcpy(&eight, tiles + w * BITS + b, 8);
+				o |= Word(equal8(eight, BlueprintBase::Wwall) ^ 0xff) << b;
+				c |= Word(equal8(eight, BlueprintBase::Wladder)
+					| equal8(eight, BlueprintBase::WliftTrack)) << b;
+				if(under) {
+					std::memcpy(&eight, under + w * BITS + b, 8);
+					s |= Word(equal8(eight, BlueprintBase::Wempty) ^ 0xff) << b;
+				}
+			}
+			for(; b < n; ++b) {
+				const uint8_t t = tiles[w * BITS + b];
+				o |= Word(t != BlueprintBase::Wwall) << b;
+				c |= Word(t == BlueprintBase::Wladder
+					|| t == BlueprintBase::WliftTrack) << b;
+				if(under)
+					s |= Word(under[w * BITS + b] != BlueprintBase::Wempty) << b;
+			}
+			open[w] = o;
+			climb[w] = c & o;
+			standing[w] = (s | c) & o;
+		}
+
+		// Walking needs the tile moved from standing, links need
+		// either of the two
+		from_left(standing, &left[0], mWords);
+		from_right(standing, &right[0], mWords);
+		from_left(open, &open_left[0], mWords);
+		from_right(open, &open_right[0], mWords);
+		Word* walk_right = row(mWalk.right, r);
+		Word* link_right = row(mLink.right, r);
+		for(int w = 0; w < mWords; ++w) {
+			walk_right[w] = open[w] & left[w];
+			link_right[w] = open[w] & open_left[w] & (standing[w] | left[w]);
+			moves[w] = open[w] & right[w];
+		}
+		reverse(&moves[0], row(mWalk.left, r));
+		for(int w = 0; w < mWords; ++w)
+			moves[w] = open[w] & open_right[w] & (standing[w] | right[w]);
+		reverse(&moves[0], row(mLink.left, r));
+	}
+}
+
+Reachability::Report Reachability::check(const IVec2& start)
+{
+	TRACE_SCOPE("Reachability::check");
+
+	Report report;
+	report.places = 0;
+	for(Word w: mStanding)
+		report.places += __builtin_popcountll(w);
+
+	IVec2 from = start;
+	if(!passable(from))
+		from = first_passable();
+	report.reached = from.x < 0 ? 0 : reach(from);
+	report.components = components();
+	return report;
+}
+
+size_t Reachability::reach(const IVec2& start)
+{
+	std::fill(mReached.begin(), mReached.end(), 0);
+	if(!passable(start))
+		return 0;
+
+	fill(mReached, start, true);
+	size_t count = 0;
+	for(size_t i = 0; i < mReached.size(); ++i)
+		count += __builtin_popcountll(mReached[i] & mStanding[i]);
+	return count;
+}
+
+size_t Reachability::components()
+{
+	std::fill(mLinked.begin(), mLinked.end(), 0);
+	size_t count = 0;
+	for(int r = 0; r < mDim.y; ++r) {
+		const Word* open = row(mOpen, r);
+		const Word* linked = row(mLinked, r);
+		for(int w = 0; w < mWords; ++w) {
+			// Filling sets more of this word
+			while(Word left = open[w] & ~linked[w]) {
+				fill(mLinked, IVec2(w * BITS + __builtin_ctzll(left), r), false);
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+IVec2 Reachability::first_passable() const
+{
+	for(int r = 0; r < mDim.y; ++r) {
+		const Word* open = row(mOpen, r);
+		for(int w = 0; w < mWords; ++w)
+			if(open[w])
+				return IVec2(w * BITS + __builtin_ctzll(open[w]), r);
+	}
+	return IVec2(-1, -1);
+}
+
+void Reachability::reverse(const Word* in, Word* out) const
+{
+	for(int w = 0; w < mWords; ++w)
+		out[mWords - 1 - w] = reverse_word(in[w]);
+}
+
+void Reachability::spread(Word* bits, int r, const Moves& moves)
+{
+	// Walking right, then left from where we were; walking left
+	// from tiles reached walking right only goes back.
+	fill_up(bits, row(moves.right, r), mWords);
+	reverse(bits, &mIn[0]);
+	fill_up(&mIn[0], row(moves.left, r), mWords);
+	reverse(&mIn[0], &mOut[0]);
+	for(int w = 0; w < mWords; ++w)
+		bits[w] |= mOut[w];
+}
+
+void Reachability::fill(std::vector<Word>& bits, const IVec2& start,
+		bool directed)
+{
+	// Sweeping down then up the rows with tiles newly reached, falls
+	// take a single sweep, and so do climbs
+	set(bits, start.y, start.x);
+	mDirty[start.y] = 1;
+	int dirty = 1, top = start.y, bottom = start.y;
+	for(bool down = true; dirty; down = !down) {
+		const int step = down ? 1 : -1;
+		for(int r = down ? top : bottom; r >= top && r <= bottom; r += step) {
+			if(!mDirty[r])
+				continue;
+			mDirty[r] = 0;
+			--dirty;
+
+			Word* cur = row(bits, r);
+			spread(cur, r, directed ? mWalk : mLink);
+
+			// Down is always possible, up only by climbing if directed
+			for(int next: {r + 1, r - 1}) {
+				if(next < 0 || next >= mDim.y)
+					continue;
+				Word* to = row(bits, next);
+				const Word* open = row(mOpen, next);
+				const Word* climb = row(mClimb, r);
+				const bool up = next < r;
+				Word grew = 0;
+				for(int w = 0; w < mWords; ++w) {
+					const Word from = directed && up ? cur[w] & climb[w] : cur[w];
+					const Word add = from & open[w] & ~to[w];
+					to[w] |= add;
+					grew |= add;
+				}
+				if(grew && !mDirty[next]) {
+					mDirty[next] = 1;
+					++dirty;
+					top = std::min(top, next);
+					bottom = std::max(bottom, next);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+
+// Which tiles of a level can be reached, following Traversal rules, to
+// reject generated levels with places nobody gets to.
+//
+// The map is kept as bitsets, a row of 64 bit words per row of tiles,
+// and flood fills work on whole words: moving down or up is an and
+// with the row above or below, and moving sideways along a row is an
+// addition, whose carries run along the tiles that can be walked
+// (leftwards on the row with its bits reversed). Rows are revisited
+// only while tiles get reached in them.
+//
+// The rules are those of Traversal, applied to whole words.
+class Reachability
+{
+public:
+	// Tiles in the air are only ever passed through falling, so only
+	// those a character can stay on count as places.
+	struct Report {
+		size_t places;	// tiles that can be stood on
+		size_t reached;	// places reached from the start
+		size_t components;	// of tiles linked by a move either way
+
+		size_t unreachable() const
+		{
+			return places - reached;
+		}
+	};
+
+	// Only the first dim.y rows and dim.x columns of map are used.
+	Reachability(const HeapMatrix<uint8_t>& map, const IVec2& dim);
+
+	// Read the tiles again, after they changed.
+	void update();
+
+	// Fill from start, and count components. Starts from the first
+	// passable tile, top to bottom then left to right, if start isn't
+	// passable.
+	Report check(const IVec2& start);
+
+	// Places reachable from start, 0 if start isn't passable.
+	size_t reach(const IVec2& start);
+
+	// As of the last reach().
+	bool reached(const IVec2& tile) const
+	{
+		return test(mReached, tile.y, tile.x);
+	}
+
+	// Sets of tiles linked by moves in either direction: regions
+	// closed off by walls. More than one means some can't be reached
+	// from anywhere.
+	size_t components();
+
+	// First tile that isn't a wall, top to bottom then left to right,
+	// (-1, -1) if there is none.
+	IVec2 first_passable() const;
+
+private:
+	typedef uint64_t Word;
+	static const int BITS = 64;
+
+	// Tiles that can be entered from the left neighbour moving right,
+	// and from the right neighbour moving left, with a row each of
+	// bits in natural and reversed order.
+	struct Moves {
+		std::vector<Word> right;
+		std::vector<Word> left;
+	};
+
+	Word* row(std::vector<Word>& bits, int r)
+	{
+		return &bits[r * mWords];
+	}
+
+	const Word* row(const std::vector<Word>& bits, int r) const
+	{
+		return &bits[r * mWords];
+	}
+
+	bool passable(const IVec2& tile) const
+	{
+		return tile.x >= 0 && tile.y >= 0 && tile.x < mDim.x && tile.y < mDim.y
+			&& test(mOpen, tile.y, tile.x);
+	}
+
+	bool test(const std::vector<Word>& bits, int r, int c) const
+	{
+		return (row(bits, r)[c / BITS] >> (c % BITS)) & 1;
+	}
+
+	void set(std::vector<Word>& bits, int r, int c)
+	{
+		row(bits, r)[c / BITS] |= Word(1) << (c % BITS);
+	}
+
+	// Bits of a row in reverse order, column c going to the
+	// mWords * BITS - 1 - c.
+	void reverse(const Word* in, Word* out) const;
+
+	// Add the tiles of row r reached by moving sideways from those
+	// already in bits.
+	void spread(Word* bits, int r, const Moves& moves);
+
+	// Set the tiles reached from start in bits, going up only by
+	// climbing if directed, freely otherwise.
+	void fill(std::vector<Word>& bits, const IVec2& start, bool directed);
+
+	const HeapMatrix<uint8_t>& mMap;
+	IVec2 mDim;
+	int mWords;
+
+	std::vector<Word> mOpen;	// not walls
+	std::vector<Word> mClimb;	// ladders and lifts
+	std::vector<Word> mStanding;	// places
+	Moves mWalk;	// moves from standing tiles
+	Moves mLink;	// moves between tiles either of which is standing
+
+	std::vector<Word> mReached;
+	std::vector<Word> mLinked;
+
+	// Rows with tiles reached since they were last spread in.
+	std::vector<uint8_t> mDirty;
+	std::vector<Word> mIn, mOut;
+};
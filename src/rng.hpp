@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+#include <random>
+
+// Small and fast random engine, xoshiro256** by Blackman and Vigna.
+// Meets the standard UniformRandomBitGenerator requirements, so it
+// can stand in for std::mt19937.
+class Xoshiro256
+{
+public:
+	typedef uint64_t result_type;
+
+	// The state is filled from the seed with splitmix64, as advised by
+	// the authors, so that close seeds give unrelated sequences.
+	explicit Xoshiro256(uint64_t seed = 0)
+	{
+		for(uint64_t& s: mState) {
+			seed += 0x9e3779b97f4a7c15u;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+			s = z ^ (z >> 31);
+		}
+	}
+
+	static constexpr result_type min()
+	{
+		return 0;
+	}
+
+	static constexpr result_type max()
+	{
+		return UINT64_MAX;
+	}
+
+	result_type operator()()
+	{
+		const uint64_t ret = rotl(mState[1] * 5, 7) * 9;
+		const uint64_t t = mState[1] << 17;
+
+		mState[2] ^= mState[0];
+		mState[3] ^= mState[1];
+		mState[1] ^= mState[2];
+		mState[0] ^= mState[3];
+		mState[2] ^= t;
+		mState[3] = rotl(mState[3], 45);
+
+		return ret;
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t mState[4];
+};
+
+// A seed different on each run.
+inline uint64_t random_seed()
+{
+	std::random_device dev;
+	return (uint64_t(dev()) << 32) ^ dev();
+}
+
+// Uniform integer in [0, n), for n > 0.
+//
+// Unlike std::uniform_int_distribution, the result for a given engine
+// state is the same with every standard library. Lemire's multiply and
+// reject: a 32x32 bit product, with a division only in the rare case
+// the low half falls in the biased range. Bounds past 32 bits, such as
+// the tile count of a mega-level, take two draws and a 64x64 bit
+// product instead.
+template<class Engine>
+uint64_t uniform_below(Engine& engine, uint64_t n)
+{
+	static_assert(Engine::min() == 0 && Engine::max() >= UINT32_MAX,
+		"The engine must give at least 32 random bits");
+	assert(n > 0);
+
+	if(n <= UINT32_MAX) {
+		const uint32_t n32 = n;
+		uint64_t m = uint64_t(uint32_t(engine())) * n32;
+		if(uint32_t(m) < n32) {
+			const uint32_t threshold = -n32 % n32;
+			while(uint32_t(m) < threshold)
+				m = uint64_t(uint32_t(engine())) * n32;
+		}
+		return m >> 32;
+	}
+
+	auto draw = [&engine]() {
+		const uint64_t high = uint32_t(engine());
+		return high << 32 | uint32_t(engine());
+	};
+	unsigned __int128 m = (unsigned __int128)draw() * n;
+	if(uint64_t(m) < n) {
+		const uint64_t threshold = -n % n;
+		while(uint64_t(m) < threshold)
+			m = (unsigned __int128)draw() * n;
+	}
+	return m >> 64;
+}
+
+// Uniform integer in [low, high].
+template<class Engine>
+int uniform_int(Engine& engine, int low, int high)
+{
+	assert(low <= high);
+	return low + int(uniform_below(engine, uint32_t(high - low) + 1));
+}
@@ -0,0 +1,145 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+#include <iomanip>
+#include "jobs.hpp"
+#include "trace.hpp"
+
+FrameScheduler::FrameScheduler(float budget, uint32_t max_wait):
+	mBudget(budget),
+	mMaxWait(max_wait),
+	mFrame(0),
+	mRun(),
+	mMaxQueued(),
+	mPromoted(0),
+	mDeferred(0),
+	mDeferredFrames(0),
+	mSpentMs(0.05),
+	mWaitFrames(1)
+{}
+
+void FrameScheduler::add(std::function<void()> work, Priority priority)
+{
+	assert(priority >= HIGH && priority < PRIORITIES);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mQueues[priority].push_back(Task{std::move(work), mFrame, mFrame});
+}
+
+void FrameScheduler::run_frame()
+{
+	TRACE_SCOPE("FrameScheduler::run_frame");
+
+	typedef std::chrono::steady_clock Clock;
+	const auto start = Clock::now();
+	const auto until = start + std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<float>(mBudget));
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		++mFrame;
+		// Normal before low, so that nothing goes up twice at once.
+		// Queues are in the order tasks got their priority, so the
+		// ones waiting longest are in front.
+		for(int p = NORMAL; p < PRIORITIES; ++p) {
+			auto& q = mQueues[p];
+			while(!q.empty() && mFrame - q.front().since >= mMaxWait) {
+				Task task = std::move(q.front());
+				q.pop_front();
+				task.since = mFrame;
+				mQueues[p - 1].push_back(std::move(task));
+				++mPromoted;
+			}
+		}
+	}
+
+	bool ran = false;
+	auto run = [&](Priority lowest) {
+		Task task;
+		Priority priority;
+		while(next(task, priority, lowest, ran && Clock::now() >= until)) {
+			task.work();
+			task.work = nullptr;
+			ran = true;
+			++mRun[priority];
+			mWaitFrames.add(mFrame - task.queued);
+		}
+	};
+	run(HIGH);
+	JobSystem::get().run_main(until);
+	run(LOW);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t left = 0;
+		for(int p = HIGH; p < PRIORITIES; ++p) {
+			left += mQueues[p].size();
+			mMaxQueued[p] = std::max(mMaxQueued[p], mQueues[p].size());
+		}
+		if(left) {
+			mDeferred += left;
+			++mDeferredFrames;
+		}
+	}
+	mSpentMs.add(std::chrono::duration<double, std::milli>(
+		Clock::now() - start).count());
+}
+
+bool FrameScheduler::next(Task& task, Priority& priority, Priority lowest,
+		bool over_budget)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(int p = HIGH; p <= lowest; ++p) {
+		auto& q = mQueues[p];
+		if(q.empty())
+			continue;
+		if(over_budget)
+			return false;
+
+		task = std::move(q.front());
+		q.pop_front();
+		priority = Priority(p);
+		return true;
+	}
+	return false;
+}
+
+size_t FrameScheduler::queued(Priority priority) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mQueues[priority].size();
+}
+
+void FrameScheduler::report(std::ostream& out) const
+{
+	static const char* NAMES[PRIORITIES] = {"high", "normal", "low"};
+
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	out << "Main thread tasks over " << mFrame << " frames, "
+		<< std::fixed << std::setprecision(1) << mBudget * 1000
+		<< " ms budget:\n"
+		<< std::setw(12) << "" << std::setw(10) << "run"
+		<< std::setw(10) << "queued" << std::setw(10) << "max" << '\n';
+	for(int p = HIGH; p < PRIORITIES; ++p)
+		out << std::left << std::setw(12) << NAMES[p] << std::right
+			<< std::setw(10) << mRun[p] << std::setw(10) << mQueues[p].size()
+			<< std::setw(10) << mMaxQueued[p] << '\n';
+	out << "  promoted " << mPromoted << ", left for next frame "
+		<< mDeferred << " in " << mDeferredFrames << " frames\n"
+		<< std::setprecision(2)
+		<< "  ms per frame: p50 " << mSpentMs.percentile(0.5)
+		<< " p99 " << mSpentMs.percentile(0.99)
+		<< " max " << mSpentMs.max() << '\n'
+		<< std::setprecision(0)
+		<< "  frames waited: p50 " << mWaitFrames.percentile(0.5)
+		<< " p99 " << mWaitFrames.percentile(0.99)
+		<< " max " << mWaitFrames.max() << '\n';
+	out.flags(flags);
+	out.precision(precision);
+	out.flush();
+}
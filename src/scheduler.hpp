@@ -0,0 +1,85 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <cstdint>
+#include "framestats.hpp"
+
+// Work for the main thread, e.g. creating scene nodes or fixtures,
+// spread over frames instead of done at once: each frame runs queued
+// tasks, most urgent first, until its time budget is spent.
+//
+// A task is never cut short, so a frame overruns the budget by at most
+// its last task. At least one task runs per frame, and tasks waiting
+// for long are promoted a priority, behind those already there, so
+// that none waits forever however many more urgent ones keep coming.
+class FrameScheduler
+{
+public:
+	enum Priority {
+		HIGH,
+		NORMAL,
+		LOW,
+		PRIORITIES
+	};
+
+	// Frames spend up to budget seconds on tasks. Tasks are promoted
+	// after waiting max_wait frames at a priority.
+	explicit FrameScheduler(float budget, uint32_t max_wait = 30);
+
+	FrameScheduler(const FrameScheduler&) = delete;
+	FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+	// From any thread.
+	void add(std::function<void()> work, Priority priority = NORMAL);
+
+	void set_budget(float budget)
+	{
+		mBudget = budget;
+	}
+
+	// Run tasks for a frame, from the main thread. The ones of the job
+	// system pinned to the main thread run after those of high priority.
+	void run_frame();
+
+	// Tasks queued, by priority.
+	size_t queued(Priority priority) const;
+
+	// Queue depths, waits and time spent so far.
+	void report(std::ostream& out) const;
+
+private:
+	struct Task {
+		std::function<void()> work;
+		// When queued, and when it got its current priority.
+		uint32_t queued, since;
+	};
+
+	// Pop the next task to run, of priority lowest or higher, false if
+	// there is none or the budget is spent.
+	bool next(Task& task, Priority& priority, Priority lowest,
+		bool over_budget);
+
+	float mBudget;
+	uint32_t mMaxWait;
+	uint32_t mFrame;
+
+	mutable std::mutex mMutex;
+	std::deque<Task> mQueues[PRIORITIES];
+
+	// Per priority, tasks run at it and most queued at the end of a
+	// frame.
+	uint64_t mRun[PRIORITIES];
+	size_t mMaxQueued[PRIORITIES];
+	uint64_t mPromoted;
+	// Tasks left for the next frame, summed over frames, and frames
+	// leaving any.
+	uint64_t mDeferred;
+	uint32_t mDeferredFrames;
+
+	// Time spent per frame in milliseconds, and frames queued to run.
+	Histogram mSpentMs;
+	Histogram mWaitFrames;
+};
@@ -0,0 +1,72 @@
+#include "snapshot.hpp"
+#include "trace.hpp"
+
+#include <cstddef>
+
+void Snapshot::save_bodies(b2World& physics)
+{
+	TRACE_SCOPE("Snapshot::save_bodies");
+
+	size_t count = 0;
+	for(b2Body* b = physics.GetBodyList(); b; b = b->GetNext())
+		count += b->GetType() != b2_staticBody;
+	write(count);
+
+	for(b2Body* b = physics.GetBodyList(); b; b = b->GetNext()) {
+		if(b->GetType() == b2_staticBody)
+			continue;
+		Body saved;
+		saved.body = b;
+		saved.position = b->GetPosition();
+		saved.angle = b->GetAngle();
+		saved.velocity = b->GetLinearVelocity();
+		saved.spin = b->GetAngularVelocity();
+		saved.awake = b->IsAwake();
+		write(saved);
+	}
+}
+
+bool Snapshot::load_bodies(b2World& physics)
+{
+	TRACE_SCOPE("Snapshot::load_bodies");
+
+	const size_t start = mRead;
+	size_t count;
+	read(count);
+
+	// The same bodies, in the same order
+	const size_t first = mRead;
+	size_t i = 0;
+	for(b2Body* b = physics.GetBodyList(); b; b = b->GetNext()) {
+		if(b->GetType() == b2_staticBody)
+			continue;
+		const b2Body* saved;
+		if(i < count)
+			std::memcpy(&saved, &mData[first + i * sizeof(Body)]
+				+ offsetof(Body, body), sizeof saved);
+		if(i >= count || saved != b) {
+			mRead = start;
+			return false;
+		}
+		++i;
+	}
+	if(i != count) {
+		mRead = start;
+		return false;
+	}
+
+	// Sleeping zeroes the velocities, which were when saved anyway
+	for(b2Body* b = physics.GetBodyList(); b; b = b->GetNext()) {
+		if(b->GetType() == b2_staticBody)
+			continue;
+		Body saved;
+		read(saved);
+		b->SetTransform(saved.position, saved.angle);
+		b->SetAwake(saved.awake);
+		if(saved.awake) {
+			b->SetLinearVelocity(saved.velocity);
+			b->SetAngularVelocity(saved.spin);
+		}
+	}
+	return true;
+}
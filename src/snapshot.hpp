@@ -0,0 +1,114 @@
+#pragma once
+
+#include "precompiled.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+// Dynamic state of the physics of a level at some step, to go back to
+// it later: for retrying from a checkpoint, or rolling back and
+// replaying steps.
+//
+// Everything goes in a flat buffer, which keeps its memory between
+// captures, so once it has grown to the size of the level, capturing
+// and restoring allocate nothing. Only what changes as the simulation
+// runs is copied: static bodies, fixtures and the tile map are left
+// where they are, shared by all the snapshots of a level.
+//
+// Box2D doesn't expose the contacts it keeps between steps, so a
+// replay from a snapshot may drift slightly from the original run,
+// as the first step warm starts from the contacts of the last one.
+class Snapshot
+{
+public:
+	Snapshot():
+		mRead(0)
+	{}
+
+	// Forget the state captured, keeping the memory.
+	void clear()
+	{
+		mData.clear();
+		mRead = 0;
+	}
+
+	// Read again from the start.
+	void rewind()
+	{
+		mRead = 0;
+	}
+
+	size_t bytes() const
+	{
+		return mData.size();
+	}
+
+	// Transforms, velocities and sleep state of every body that
+	// isn't static.
+	void save_bodies(b2World& physics);
+
+	// Returns false, changing nothing, if bodies were created or
+	// destroyed since save_bodies().
+	bool load_bodies(b2World& physics);
+
+	// Plain values, as they are in memory.
+	template<class T>
+	void write(const std::vector<T>& values)
+	{
+		write(values.size());
+		write(values.data(), values.size());
+	}
+
+	template<class T>
+	void write(const T* values, size_t count)
+	{
+		const size_t at = mData.size();
+		mData.resize(at + count * sizeof(T));
+		std::memcpy(mData.data() + at, values, count * sizeof(T));
+	}
+
+	template<class T>
+	void write(const T& value)
+	{
+		write(&value, 1);
+	}
+
+	// In the order written, into as many values as were.
+	template<class T>
+	void read(std::vector<T>& values)
+	{
+		size_t count;
+		read(count);
+		assert(count == values.size());
+		read(values.data(), count);
+	}
+
+	template<class T>
+	void read(T* values, size_t count)
+	{
+		assert(mRead + count * sizeof(T) <= mData.size());
+		std::memcpy(values, mData.data() + mRead, count * sizeof(T));
+		mRead += count * sizeof(T);
+	}
+
+	template<class T>
+	void read(T& value)
+	{
+		read(&value, 1);
+	}
+
+private:
+	struct Body {
+		const b2Body* body;
+		b2Vec2 position;
+		float angle;
+		b2Vec2 velocity;
+		float spin;
+		bool awake;
+	};
+
+	std::vector<unsigned char> mData;
+	size_t mRead;
+};
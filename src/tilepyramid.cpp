@@ -0,0 +1,133 @@
+#include "tilepyramid.hpp"
+#include "blueprint.hpp"
+#include "trace.hpp"
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+	// Below this many cells, jobs cost more than they save.
+	const int PARALLEL_MIN_CELLS = 1 << 16;
+
+	// Narrowest band of rows given to a job.
+	const int MIN_BAND_ROWS = 32;
+
+	// The lowest of the most common tiles among count, unless more
+	// are empty.
+	uint8_t dominant(const uint8_t* tiles, int count)
+	{
+		if(count == 4 && tiles[0] == tiles[1] && tiles[0] == tiles[2]
+				&& tiles[0] == tiles[3])
+			return tiles[0];
+
+		uint8_t best = BlueprintBase::Wempty;
+		int most = 0, empty = 0;
+		for(int i = 0; i < count; ++i) {
+			if(tiles[i] == BlueprintBase::Wempty) {
+				++empty;
+				continue;
+			}
+			int same = 0;
+			for(int j = 0; j < count; ++j)
+				same += tiles[j] == tiles[i];
+			if(same > most || (same == most && tiles[i] < best)) {
+				best = tiles[i];
+				most = same;
+			}
+		}
+		return empty > most ? uint8_t(BlueprintBase::Wempty) : best;
+	}
+}
+
+TilePyramid::TilePyramid(const HeapMatrix<uint8_t>& map, const IVec2& dim):
+	mMap(map),
+	mDim(dim)
+{
+	assert(dim.x > 0 && dim.y > 0);
+}
+
+void TilePyramid::build()
+{
+	TRACE_SCOPE("TilePyramid::build");
+
+	mLevels.clear();
+	JobSystem& jobs = JobSystem::get();
+	for(int k = 1; size(k - 1) != IVec2(1, 1); ++k) {
+		const IVec2 dim = size(k);
+		mLevels.emplace_back(dim.y, dim.x);
+
+		// Each level needs the whole one below
+		int bands = 1;
+		if(dim.x * dim.y >= PARALLEL_MIN_CELLS) {
+			bands = std::min<int>(jobs.workers() + 1, dim.y / MIN_BAND_ROWS);
+			bands = std::max(bands, 1);
+		}
+		std::vector<JobSystem::Job> band_jobs;
+		for(int b = 1; b < bands; ++b) {
+			band_jobs.push_back(jobs.add([this, k, b, bands, dim]() {
+				reduce(k, dim.y * b / bands, dim.y * (b + 1) / bands);
+			}));
+		}
+		reduce(k, 0, dim.y / bands);
+		jobs.wait(band_jobs);
+	}
+}
+
+void TilePyramid::update(const std::vector<IVec2>& tiles)
+{
+	std::vector<IVec2> cells(tiles), above;
+	for(int k = 1; k < levels(); ++k) {
+		above.clear();
+		for(const IVec2& c: cells)
+			above.push_back(IVec2(c.x / 2, c.y / 2));
+		std::sort(above.begin(), above.end(), [](const IVec2& a, const IVec2& b) {
+			return a.y < b.y || (a.y == b.y && a.x < b.x);
+		});
+		above.erase(std::unique(above.begin(), above.end()), above.end());
+		for(const IVec2& c: above)
+			reduce_cell(k, c.y, c.x);
+		cells.swap(above);
+	}
+}
+
+void TilePyramid::reduce(int k, int begin, int end)
+{
+	const HeapMatrix<uint8_t>& below = level(k - 1);
+	const IVec2 dim = size(k - 1);
+	const int cols = size(k).x;
+	HeapMatrix<uint8_t>& cells = mLevels[k - 1];
+	for(int i = begin; i < end; ++i) {
+		// Rows and columns past the end of the level below have a
+		// single cell under them
+		if(i * 2 + 1 >= dim.y) {
+			for(int j = 0; j < cols; ++j)
+				reduce_cell(k, i, j);
+			continue;
+		}
+		const uint8_t* top = &below[i * 2][0];
+		const uint8_t* bottom = &below[i * 2 + 1][0];
+		uint8_t* out = &cells[i][0];
+		for(int j = 0; j < dim.x / 2; ++j) {
+			const uint8_t four[4] = {
+				top[j * 2], top[j * 2 + 1], bottom[j * 2], bottom[j * 2 + 1]
+			};
+			out[j] = dominant(four, 4);
+		}
+		if(dim.x % 2)
+			reduce_cell(k, i, cols - 1);
+	}
+}
+
+void TilePyramid::reduce_cell(int k, int row, int col)
+{
+	const HeapMatrix<uint8_t>& below = level(k - 1);
+	const IVec2 dim = size(k - 1);
+
+	uint8_t under[4];
+	int count = 0;
+	for(int i = row * 2; i < std::min(row * 2 + 2, dim.y); ++i)
+		for(int j = col * 2; j < std::min(col * 2 + 2, dim.x); ++j)
+			under[count++] = below[i][j];
+	mLevels[k - 1][row][col] = dominant(under, count);
+}
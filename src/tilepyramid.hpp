@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+
+// Coarser and coarser copies of a tile map, for drawing it from afar.
+// Level 0 is the map itself, and a cell of level k stands for the 2x2
+// cells of level k - 1 below it, with the type most of them have. Tiles
+// win ties with empty ones, so that walls one tile thick don't vanish
+// on the way up, and walls win ties with the other tiles.
+//
+// Levels go on until one is a single cell, taking a third of the map
+// together.
+class TilePyramid
+{
+public:
+	// Only the first dim.y rows and dim.x columns of map are used. The
+	// levels are empty until build().
+	TilePyramid(const HeapMatrix<uint8_t>& map, const IVec2& dim);
+
+	// All the levels, each split in bands of rows run as jobs.
+	void build();
+
+	// Tiles of the map changed, update the cells above them.
+	void update(const std::vector<IVec2>& tiles);
+
+	// Including level 0.
+	int levels() const
+	{
+		return mLevels.size() + 1;
+	}
+
+	const HeapMatrix<uint8_t>& level(int k) const
+	{
+		return k ? mLevels[k - 1] : mMap;
+	}
+
+	// Columns and rows of a level.
+	IVec2 size(int k) const
+	{
+		return IVec2(((mDim.x - 1) >> k) + 1, ((mDim.y - 1) >> k) + 1);
+	}
+
+private:
+	// Cells of level k from row begin to row end.
+	void reduce(int k, int begin, int end);
+	void reduce_cell(int k, int row, int col);
+
+	const HeapMatrix<uint8_t>& mMap;
+	IVec2 mDim;
+	std::vector<HeapMatrix<uint8_t> > mLevels;
+};
@@ -0,0 +1,108 @@
+#include "trace.hpp"
+
+#if DEBUG
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+namespace trace {
+
+namespace {
+	// Events kept per thread, the oldest ones are overwritten.
+	const uint64_t CAPACITY = 1 << 16;
+
+	struct Event {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// Only written by its own thread, which publishes each event by
+	// bumping count once it is filled.
+	struct Buffer {
+		Event events[CAPACITY];
+		std::atomic<uint64_t> count;
+		unsigned tid;
+	};
+
+	const std::chrono::steady_clock::time_point epoch =
+		std::chrono::steady_clock::now();
+
+	// Buffers are never freed, so the events of threads that
+	// already exited still get written.
+	std::mutex registry_mutex;
+	std::vector<Buffer*> registry;
+
+	thread_local Buffer* buffer = nullptr;
+
+	Buffer* register_thread()
+	{
+		Buffer* b = new Buffer;
+		b->count.store(0, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		b->tid = registry.size();
+		registry.push_back(b);
+		return b;
+	}
+}
+
+uint64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char* name, uint64_t start, uint64_t end)
+{
+	if(!buffer)
+		buffer = register_thread();
+
+	const uint64_t n = buffer->count.load(std::memory_order_relaxed);
+	Event& e = buffer->events[n % CAPACITY];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+bool write_json(const char* filename)
+{
+	std::ofstream out(filename);
+	if(!out)
+		return false;
+
+	std::vector<Buffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		buffers = registry;
+	}
+
+	// Timestamps are in microseconds. Threads still tracing while this
+	// runs may overwrite their oldest events as they are written out.
+	out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+	const char* separator = "\n";
+	for(Buffer* b: buffers) {
+		const uint64_t count = b->count.load(std::memory_order_acquire);
+		for(uint64_t i = count > CAPACITY ? count - CAPACITY : 0; i < count; ++i) {
+			const Event& e = b->events[i % CAPACITY];
+			out << separator
+				<< "{\"name\":\"" << e.name
+				<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+				<< ",\"ts\":" << e.start / 1000.0
+				<< ",\"dur\":" << (e.end - e.start) / 1000.0 << '}';
+			separator = ",\n";
+		}
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return bool(out);
+}
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+// Scoped timers, recorded in a lock-free ring buffer per thread and
+// exported in the Chrome trace event format, for chrome://tracing or
+// ui.perfetto.dev. Everything compiles out when DEBUG is 0.
+//
+//	void Level::build_tiles()
+//	{
+//		TRACE_SCOPE("Level::build_tiles");
+//		...
+//
+// Names are kept as pointers: use string literals.
+
+#if DEBUG
+
+#define TRACE_CAT2(a, b) a ## b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CAT(trace_scope_, __LINE__)(name)
+
+namespace trace {
+	// Nanoseconds since the program started.
+	uint64_t now();
+
+	// Record a finished scope on the calling thread.
+	void record(const char* name, uint64_t start, uint64_t end);
+
+	class Scope
+	{
+	public:
+		explicit Scope(const char* name):
+			mName(name), mStart(now())
+		{}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope()
+		{
+			record(mName, mStart, now());
+		}
+
+	private:
+		const char* mName;
+		uint64_t mStart;
+	};
+
+	// Write the events still in the buffers of every thread that
+	// traced anything. False if the file couldn't be written.
+	bool write_json(const char* filename);
+}
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+
+namespace trace {
+	inline bool write_json(const char*)
+	{
+		return true;
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include "heapmatrix.hpp"
+#include "vec2.hpp"
+#include "blueprint.hpp"
+
+// How a one tile character gets around the tile map, shared by the
+// navigation code:
+//  - walls block, the outside of the map too;
+//  - walking sideways needs something to stand on (or a ladder);
+//  - climbing up needs a ladder, or a lift to ride;
+//  - going down is always possible, by climbing or falling.
+class Traversal
+{
+public:
+	// Only the first dim.y rows and dim.x columns of map are used.
+	Traversal(const HeapMatrix<uint8_t>& map, const IVec2& dim):
+		mMap(map), mDim(dim)
+	{}
+
+	const IVec2& getDim() const
+	{
+		return mDim;
+	}
+
+	bool inside(int row, int col) const
+	{
+		return row >= 0 && col >= 0 && row < mDim.y && col < mDim.x;
+	}
+
+	bool passable(int row, int col) const
+	{
+		return inside(row, col) && mMap[row][col] != Blueprint::Wwall;
+	}
+
+	bool climbable(int row, int col) const
+	{
+		return mMap[row][col] == Blueprint::Wladder
+			|| mMap[row][col] == Blueprint::WliftTrack;
+	}
+
+	// Whether a character at a passable tile doesn't fall.
+	bool standing(int row, int col) const
+	{
+		return climbable(row, col) || row + 1 >= mDim.y
+			|| mMap[row + 1][col] != Blueprint::Wempty;
+	}
+
+	// Whether a character can go from a passable tile to one of its
+	// four neighbours.
+	bool can_move(const IVec2& from, const IVec2& to) const
+	{
+		if(!passable(to.y, to.x))
+			return false;
+		if(to.y > from.y)
+			return true;
+		if(to.y < from.y)
+			return climbable(from.y, from.x);
+		return standing(from.y, from.x);
+	}
+
+private:
+	const HeapMatrix<uint8_t>& mMap;
+	IVec2 mDim;
+};
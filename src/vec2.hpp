@@ -45,12 +45,12 @@ public:
 		return *this;
 	}
 
-	bool operator==(const Vec2& other)
+	bool operator==(const Vec2& other) const
 	{
 		return x == other.x && y == other.y;
 	}
 
-	bool operator!=(const Vec2& other)
+	bool operator!=(const Vec2& other) const
 	{
 		return x != other.x || y != other.y;
 	}